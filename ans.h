@@ -0,0 +1,222 @@
+//
+// ans.h
+//
+// A table-based asymmetric numeral systems (tANS) entropy coder, the
+// alternative to Huffman coding for skewed byte distributions.  Huffman
+// codes spend at least one bit per symbol; tANS spends about log2(L / f)
+// bits for a symbol with normalized count f, so a byte that makes up 97% of
+// a block costs a few hundredths of a bit instead of a whole one.
+//
+// Counts come from the same byte histogram the Huffman path uses and are
+// normalized to sum to L = 2^tableLog.  Symbols are spread over the L
+// decoder states, and both directions are driven by tables:
+//      decode: state -> (symbol, number of bits, next state base)
+//      encode: (symbol, sub-state) -> state
+// The encoder runs backwards over the input, so its bit chunks are written
+// in reverse order; the bitstream starts with the final encoder state.
+//
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+#include "bitbuffer.h"
+
+using namespace std;
+
+const int ANS_TABLE_LOG = 11;
+const int ANS_MAX_TABLE_LOG = 15;
+const int ANS_SYMBOLS = 256;
+
+struct ansentry {
+    unsigned short base;  // next state, before adding the bits read
+    unsigned char symbol;
+    unsigned char nbBits;
+};
+
+//
+// *This function returns the index of the highest set bit of v (v > 0).
+//
+inline int ansHighBit(unsigned int v) {
+    return 31 - __builtin_clz(v);
+}
+
+//
+// *This function normalizes counts so that they sum to 2^tableLog, keeping
+// every symbol that occurs at a count of at least one.  Rounding goes to the
+// symbols it costs the least.
+//
+inline void normalizeCounts(const vector<int> &counts, int tableLog,
+                            vector<int> &norm) {
+    int L = 1 << tableLog;
+    norm.assign(counts.size(), 0);
+    double total = 0;
+    for (unsigned int s = 0; s < counts.size(); s++) total += counts[s];
+    if (total == 0) return;
+
+    int sum = 0;
+    vector<double> exact(counts.size(), 0);
+    for (unsigned int s = 0; s < counts.size(); s++) {
+        if (counts[s] == 0) continue;
+        exact[s] = (double)counts[s] * L / total;  // counts[s] * L overflows
+        norm[s] = max(1, (int)exact[s]);
+        sum += norm[s];
+    }
+    // hand out the remainder one at a time to the largest rounding losses
+    while (sum < L) {
+        int best = -1;
+        double bestGain = -1;
+        for (unsigned int s = 0; s < counts.size(); s++) {
+            if (counts[s] == 0) continue;
+            double gain = exact[s] - norm[s];
+            if (gain > bestGain) {
+                bestGain = gain;
+                best = s;
+            }
+        }
+        if (best < 0) break;
+        norm[best]++;
+        exact[best] -= 1;  // so the next unit goes elsewhere first
+        sum++;
+    }
+    // take back the excess from the symbols where it costs the fewest bits
+    while (sum > L) {
+        int best = -1;
+        double bestCost = 0;
+        for (unsigned int s = 0; s < counts.size(); s++) {
+            if (norm[s] <= 1) continue;
+            double cost = counts[s] * log2((double)norm[s] / (norm[s] - 1));
+            if (best < 0 || cost < bestCost) {
+                bestCost = cost;
+                best = s;
+            }
+        }
+        if (best < 0) break;
+        norm[best]--;
+        sum--;
+    }
+}
+
+//
+// *This function spreads the symbols over the 2^tableLog states.  The step is
+// odd, so it visits every state once.
+//
+inline void ansSpread(const vector<int> &norm, int tableLog,
+                      vector<unsigned char> &spread) {
+    int L = 1 << tableLog;
+    int mask = L - 1;
+    int step = (L >> 1) + (L >> 3) + 3;
+    spread.assign(L, 0);
+    int pos = 0;
+    for (unsigned int s = 0; s < norm.size(); s++) {
+        for (int i = 0; i < norm[s]; i++) {
+            spread[pos] = (unsigned char)s;
+            pos = (pos + step) & mask;
+        }
+    }
+}
+
+//
+// *This function builds the decode table from normalized counts.
+//
+inline void buildANSDecodeTable(const vector<int> &norm, int tableLog,
+                                vector<ansentry> &table) {
+    int L = 1 << tableLog;
+    vector<unsigned char> spread;
+    ansSpread(norm, tableLog, spread);
+    vector<int> next(norm);
+    table.resize(L);
+    for (int i = 0; i < L; i++) {
+        int s = spread[i];
+        int y = next[s]++;  // sub-state in [norm[s], 2 * norm[s])
+        int nbBits = tableLog - ansHighBit(y);
+        table[i].symbol = (unsigned char)s;
+        table[i].nbBits = (unsigned char)nbBits;
+        table[i].base = (unsigned short)((y << nbBits) - L);
+    }
+}
+
+//
+// *This function builds the encode table: states[start[s] + y - norm[s]] is
+// the encoder state for symbol s and sub-state y.
+//
+inline void buildANSEncodeTable(const vector<int> &norm, int tableLog,
+                                vector<unsigned short> &states,
+                                vector<int> &start) {
+    int L = 1 << tableLog;
+    vector<unsigned char> spread;
+    ansSpread(norm, tableLog, spread);
+    start.assign(norm.size(), 0);
+    for (unsigned int s = 1; s < norm.size(); s++) {
+        start[s] = start[s - 1] + norm[s - 1];
+    }
+    vector<int> next(start);
+    states.resize(L);
+    for (int i = 0; i < L; i++) {
+        states[next[spread[i]]++] = (unsigned short)(L + i);
+    }
+}
+
+//
+// *This function returns the size in bytes of ansEncode's output for bytes
+// with the given counts, from the cost of tableLog - log2(norm) bits per
+// symbol plus the final state.  It is within a few bytes of the real size,
+// without encoding.
+//
+inline size_t ansEncodedSize(const vector<int> &counts, const vector<int> &norm,
+                             int tableLog) {
+    double bits = tableLog;
+    for (unsigned int s = 0; s < counts.size(); s++) {
+        if (counts[s] > 0) bits += counts[s] * (tableLog - log2(norm[s]));
+    }
+    return (size_t)(bits / 8) + 1;
+}
+
+//
+// *This function tANS encodes n bytes to output.  Every byte must have a
+// non-zero normalized count.
+//
+inline void ansEncode(const unsigned char* in, size_t n,
+                      const vector<int> &norm, int tableLog,
+                      obitbuffer &output) {
+    vector<unsigned short> states;
+    vector<int> start;
+    buildANSEncodeTable(norm, tableLog, states, start);
+    vector<int> highBit(norm.size(), 0);
+    for (unsigned int s = 0; s < norm.size(); s++) {
+        if (norm[s] > 0) highBit[s] = ansHighBit(norm[s]);
+    }
+
+    // each chunk is (bits << 5) | number of bits
+    vector<uint32_t> chunks(n);
+    unsigned int x = 1u << tableLog;
+    for (size_t k = n; k-- > 0;) {
+        int s = in[k];
+        int nbBits = tableLog - highBit[s];
+        if ((int)(x >> nbBits) < norm[s]) nbBits--;
+        chunks[k] = ((x & ((1u << nbBits) - 1)) << 5) | nbBits;
+        x = states[start[s] + (x >> nbBits) - norm[s]];
+    }
+    output.writeBits(x - (1u << tableLog), tableLog);
+    for (size_t k = 0; k < n; k++) {
+        output.writeBits(chunks[k] >> 5, chunks[k] & 31);
+    }
+}
+
+//
+// *This function decodes n bytes written by ansEncode.  Returns false if the
+// data does not end in the encoder's starting state.
+//
+inline bool ansDecode(ibitbuffer &input, size_t n, const vector<int> &norm,
+                      int tableLog, unsigned char* out) {
+    vector<ansentry> table;
+    buildANSDecodeTable(norm, tableLog, table);
+    const ansentry* t = table.data();
+    unsigned int state = (unsigned int)input.readBits(tableLog);
+    for (size_t k = 0; k < n; k++) {
+        const ansentry &e = t[state];
+        out[k] = e.symbol;
+        state = e.base + (unsigned int)input.readBits(e.nbBits);
+    }
+    return state == 0 && !input.overrun();
+}
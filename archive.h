@@ -0,0 +1,456 @@
+//
+// archive.h
+//
+// An archive stores many files (members) in one compressed file.  Each
+// member is coded as block records (block.h), and a central directory at the
+// end lists every member's name, sizes, offset and CRC32C, so one member can
+// be extracted by seeking straight to it.  A fixed-size footer points back
+// to the directory, the same way a block frame's footer points to its index.
+//
+// A small member would spend much of its record on its own frequency table.
+// The archive therefore carries one shared Huffman table, built from the
+// bytes of its small members, and a small member is coded with it
+// (BACKEND_SHARED, an empty table in the record) whenever that comes out
+// smaller than its own best block.
+//
+// Members are read and compressed in parallel batches and written in order.
+// A batch holds at most ARCHIVE_BATCH_BYTES of members; a member larger
+// than that is streamed a block at a time instead.  Extraction streams too,
+// and only writes members whose names are relative and free of "..".
+//
+// File layout:
+//      #A<member count>\n
+//      {shared table}\n
+//      <block records> ...                                  per member
+//      C<member count>\n
+//          <raw size> <compressed size> <offset> <crc>
+//          <name length>:<name>\n ...                        directory
+//      #C<bytes from directory to footer, 16 digits>\n      footer
+// where offsets are from the start of the archive.
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include "hashmap.h"
+#include "huffcode.h"
+#include "flattree.h"
+#include "block.h"
+#include "checksum.h"
+#include "parallel.h"
+#include "util.h"
+
+using namespace std;
+
+const char ARCHIVE_MODE = 'A';
+const char DIRECTORY_RECORD = 'C';
+const size_t ARCHIVE_SMALL_MEMBER = 16 * 1024;
+const size_t ARCHIVE_SHARED_SAMPLE = 4 * 1024 * 1024;
+const size_t ARCHIVE_BATCH_BYTES = 64 * 1024 * 1024;
+
+struct archivemember {
+    string name;
+    size_t rawSize;
+    size_t compressedSize;
+    size_t offset;    // where the member's first record starts
+    uint32_t checksum;  // CRC32C of the member's bytes
+};
+
+//
+// *This function builds the shared table from the small members among
+// files, reading at most ARCHIVE_SHARED_SAMPLE bytes of them.  Every byte
+// gets a count of at least one, so any member can be coded with it.
+// Returns false if there are fewer than two small members to share it.
+//
+inline bool buildSharedTable(const vector<string> &files, hashmapF &table) {
+    vector<int> counts(ANS_SYMBOLS, 1);
+    size_t sampled = 0;
+    int members = 0;
+    for (unsigned int i = 0; i < files.size(); i++) {
+        if (sampled >= ARCHIVE_SHARED_SAMPLE) break;
+        ifstream input(files[i], ios::binary | ios::ate);
+        if (!input.is_open() ||
+            (size_t)input.tellg() > ARCHIVE_SMALL_MEMBER) {
+            continue;
+        }
+        vector<unsigned char> data((size_t)input.tellg());
+        input.seekg(0);
+        if (!data.empty()) input.read((char*)data.data(), data.size());
+        for (size_t j = 0; j < data.size(); j++) counts[data[j]]++;
+        sampled += data.size();
+        members++;
+    }
+    if (members < 2) return false;
+    buildFrequencyMap(counts, table);
+    return true;
+}
+
+//
+// *This function codes one member, size bytes, as block records into
+// output.  A member that fits in one block is coded with the shared codes
+// instead when that is smaller; shared is empty when the archive has no
+// shared table.  block is scratch space, so a caller coding many members
+// can keep its buffers.
+//
+inline void encodeMember(const unsigned char* data, size_t size,
+                         const vector<HuffmanCode> &shared, huffblock &block,
+                         ostream &output) {
+    for (size_t start = 0; start < size; start += BLOCK_DEFAULT_SIZE) {
+        size_t n = min(size - start, (size_t)BLOCK_DEFAULT_SIZE);
+        const unsigned char* bytes = data + start;
+        encodeBlock(bytes, n, block);
+        if (!shared.empty() && n == size) {
+            size_t sharedBits = 0;
+            for (size_t i = 0; i < n; i++) {
+                sharedBits += shared[bytes[i]].length;
+            }
+            size_t own = tableSize(block.table) + block.payload.size();
+            if (2 + (sharedBits + 7) / 8 < own) {  // "{}" and the payload
+                obitbuffer bits;
+                huffmanEncodeBlock(bytes, n, shared, bits);
+                block.backend = BACKEND_SHARED;
+                block.filter = FILTER_NONE;
+                block.table = hashmapF();
+                block.payload.swap(bits.bytes());
+                block.payloadChecksum = crc32c(0, block.payload.data(),
+                                               block.payload.size());
+            }
+        }
+        writeBlock(output, block);
+    }
+}
+
+//
+// *This function codes the member input holds, size bytes long, as block
+// records into output a block at a time, so it is never held whole.  Fills
+// in member's sizes and checksum.  Returns false if it cannot be read.
+//
+inline bool streamMember(istream &input, size_t size, ostream &output,
+                         archivemember &member) {
+    vector<unsigned char> data(BLOCK_DEFAULT_SIZE);
+    huffblock block;
+    size_t start = (size_t)output.tellp();
+    member.rawSize = 0;
+    member.checksum = 0;
+    while (member.rawSize < size) {
+        size_t n = min(size - member.rawSize, (size_t)BLOCK_DEFAULT_SIZE);
+        input.read((char*)data.data(), n);
+        if ((size_t)input.gcount() != n) return false;
+        encodeBlock(data.data(), n, block);
+        writeBlock(output, block);
+        member.checksum = crc32c(member.checksum, data.data(), n);
+        member.rawSize += n;
+    }
+    member.compressedSize = (size_t)output.tellp() - start;
+    return true;
+}
+
+//
+// *This function returns true if a member called name may be written: it
+// is not empty, not absolute and has no ".." component, so extracting it
+// cannot write outside the current directory.
+//
+inline bool safeMemberName(const string &name) {
+    if (name.empty() || name[0] == '/') return false;
+    size_t start = 0;
+    while (start <= name.length()) {
+        size_t end = name.find('/', start);
+        if (end == string::npos) end = name.length();
+        if (name.compare(start, end - start, "..") == 0) return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+//
+// *This function writes the central directory and the footer that points to
+// it.
+//
+inline void writeDirectory(ostream &output,
+                           const vector<archivemember> &members) {
+    size_t directoryOffset = (size_t)output.tellp();
+    output << DIRECTORY_RECORD << members.size() << '\n';
+    for (unsigned int i = 0; i < members.size(); i++) {
+        const archivemember &m = members[i];
+        output << m.rawSize << ' ' << m.compressedSize << ' ' << m.offset
+               << ' ' << hex << m.checksum << dec << ' ' << m.name.length()
+               << ':' << m.name << '\n';
+    }
+    size_t footerOffset = (size_t)output.tellp();
+    output << HEADER_TAG << DIRECTORY_RECORD << setw(FOOTER_SIZE - 3)
+           << setfill('0') << footerOffset - directoryOffset << setfill(' ')
+           << '\n';
+}
+
+//
+// *This function reads an archive's shared table and central directory.
+// Counts and lengths are checked against the bytes between the directory
+// and the footer before anything is allocated for them.  Returns false if
+// the file is not an archive or its directory is corrupt.
+//
+inline bool readDirectory(istream &input, hashmapF &shared,
+                          vector<archivemember> &members) {
+    size_t count = 0;
+    shared = hashmapF();
+    if (input.get() != HEADER_TAG || input.get() != ARCHIVE_MODE ||
+        !(input >> count) || input.get() != '\n' ||
+        !readFrequencyMap(input, shared, ANS_SYMBOLS)) {
+        return false;
+    }
+    input.seekg(0, ios::end);
+    long fileSize = (long)input.tellg();
+    char footer[FOOTER_SIZE + 1] = {0};
+    if (fileSize < FOOTER_SIZE) return false;
+    long directoryEnd = fileSize - FOOTER_SIZE;
+    input.seekg(directoryEnd);
+    input.read(footer, FOOTER_SIZE);
+    if (footer[0] != HEADER_TAG || footer[1] != DIRECTORY_RECORD) return false;
+    long directoryStart = directoryEnd - atol(footer + 2);
+    if (directoryStart < 0 || directoryStart > directoryEnd) return false;
+    input.seekg(directoryStart);
+    // every entry takes more than one byte
+    if (input.get() != DIRECTORY_RECORD || !(input >> count) ||
+        count > (size_t)(directoryEnd - directoryStart)) {
+        return false;
+    }
+    members.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        archivemember &m = members[i];
+        size_t length = 0;
+        if (!(input >> m.rawSize >> m.compressedSize >> m.offset >> hex
+                    >> m.checksum >> dec >> length) ||
+            input.get() != ':' ||
+            (long)input.tellg() + (long long)length > directoryEnd ||
+            length > (size_t)directoryEnd) {
+            return false;
+        }
+        m.name.resize(length);
+        if (length > 0) input.read(&m.name[0], length);
+    }
+    return (bool)input;
+}
+
+//
+// *This function compresses files into one archive named archivename.
+// Returns the archive size in bytes, or -1 if a file cannot be read.
+//
+inline long archiveCompress(string archivename, const vector<string> &files) {
+    hashmapF sharedTable;
+    vector<HuffmanCode> shared;
+    if (buildSharedTable(files, sharedTable)) {
+        HuffmanNode* tree = buildCodingTree(sharedTable);
+        shared = buildCodeTable(tree, ANS_SYMBOLS);
+        freeTree(tree);
+    }
+    ofstream output(archivename, ios::binary);
+    output << HEADER_TAG << ARCHIVE_MODE << files.size() << '\n'
+           << sharedTable << '\n';
+
+    vector<archivemember> members;
+    for (unsigned int i = 0; i < files.size(); i++) {
+        if (!safeMemberName(files[i])) {
+            cout << "Member names must be relative, without \"..\": "
+                 << files[i] << endl;
+            output.close();
+            remove(archivename.c_str());
+            return -1;
+        }
+    }
+    int batch = workerCount() * 4;
+    unsigned int first = 0;
+    while (first < files.size()) {
+        ifstream large(files[first], ios::binary | ios::ate);
+        size_t size = large.is_open() ? (size_t)large.tellg() : 0;
+        if (size > ARCHIVE_BATCH_BYTES) {
+            archivemember member;
+            member.name = files[first];
+            member.offset = (size_t)output.tellp();
+            large.seekg(0);
+            if (!streamMember(large, size, output, member)) {
+                cout << "Cannot read " << files[first] << endl;
+                output.close();
+                remove(archivename.c_str());
+                return -1;
+            }
+            members.push_back(member);
+            first++;
+            continue;
+        }
+        // the batch ends before a large member or ARCHIVE_BATCH_BYTES
+        int count = 0;
+        size_t batchBytes = 0;
+        while (count < batch && first + count < files.size()) {
+            ifstream next(files[first + count], ios::binary | ios::ate);
+            size = next.is_open() ? (size_t)next.tellg() : 0;
+            if (count > 0 && (size > ARCHIVE_BATCH_BYTES ||
+                              batchBytes + size > ARCHIVE_BATCH_BYTES)) {
+                break;
+            }
+            batchBytes += size;
+            count++;
+        }
+        vector<string> coded(count);
+        vector<archivemember> found(count);
+        vector<char> ok(count, 0);
+        parallelFor(count, [&](int i) {
+            vector<unsigned char> data;
+            ifstream input(files[first + i], ios::binary | ios::ate);
+            if (!input.is_open()) return;
+            data.resize((size_t)input.tellg());
+            input.seekg(0);
+            if (!data.empty()) input.read((char*)data.data(), data.size());
+            found[i].name = files[first + i];
+            found[i].rawSize = data.size();
+            found[i].checksum = crc32c(0, data.data(), data.size());
+            ostringstream ss;
+            huffblock block;
+            encodeMember(data.data(), data.size(), shared, block, ss);
+            coded[i] = ss.str();
+            ok[i] = 1;
+        });
+        for (int i = 0; i < count; i++) {
+            if (!ok[i]) {
+                cout << "File does not exist: " << files[first + i] << endl;
+                output.close();
+                remove(archivename.c_str());
+                return -1;
+            }
+            found[i].offset = (size_t)output.tellp();
+            found[i].compressedSize = coded[i].size();
+            output << coded[i];
+            members.push_back(found[i]);
+        }
+        first += count;
+    }
+    writeDirectory(output, members);
+    long size = (long)output.tellp();
+    output.close();
+    return size;
+}
+
+//
+// *This function reads and decodes block records from input until rawSize
+// bytes are decoded, and appends them to data.  shared is the shared
+// table's flattened tree, or nullptr; block and out are scratch space, so a
+// caller decoding many payloads can keep its buffers.  Nothing is reserved
+// for rawSize, which comes from the input.  Returns false if the records
+// are corrupt.
+//
+inline bool decodeRecords(istream &input, size_t rawSize,
+                          const flattree* shared, huffblock &block,
+                          vector<unsigned char> &out,
+                          vector<unsigned char> &data) {
+    size_t decoded = 0;
+    while (decoded < rawSize) {
+        if (!readBlock(input, block, BLOCK_DEFAULT_SIZE) ||
+            !decodeBlock(block, out, false, shared) ||
+            out.size() > rawSize - decoded) {
+            return false;
+        }
+        data.insert(data.end(), out.begin(), out.end());
+        decoded += out.size();
+    }
+    return true;
+}
+
+//
+// *This function decodes one member, which input holds at its offset, into
+// output a block at a time.  Returns false if it is corrupt or its checksum
+// does not match.
+//
+inline bool decodeMember(istream &input, const archivemember &member,
+                         const flattree* shared, ostream &output) {
+    input.clear();
+    input.seekg(member.offset);
+    huffblock block;
+    vector<unsigned char> out;
+    size_t written = 0;
+    uint32_t checksum = 0;
+    while (written < member.rawSize) {
+        if (!readBlock(input, block, BLOCK_DEFAULT_SIZE) ||
+            !decodeBlock(block, out, false, shared) ||
+            out.size() > member.rawSize - written) {
+            return false;
+        }
+        writeBytes(output, out.data(), out.size());
+        checksum = crc32c(checksum, out.data(), out.size());
+        written += out.size();
+    }
+    return checksum == member.checksum;
+}
+
+//
+// *This function returns the name a member is extracted to: its own name
+// with "_unc" before the extension, the way decompress names its output.
+//
+inline string extractedFilename(string name) {
+    size_t slash = name.rfind('/');
+    size_t dot = name.rfind('.');
+    if (dot == string::npos || (slash != string::npos && dot < slash)) {
+        return name + "_unc";
+    }
+    return name.substr(0, dot) + "_unc" + name.substr(dot);
+}
+
+//
+// *This function extracts the member called name from an archive, or every
+// member if name is empty.  Returns false if the archive or a member is
+// corrupt, or there is no such member.
+//
+inline bool archiveExtract(string archivename, string name) {
+    ifstream input(archivename, ios::binary);
+    hashmapF shared;
+    vector<archivemember> members;
+    if (!readDirectory(input, shared, members)) {
+        cout << "Not an archive, or its directory is corrupt." << endl;
+        return false;
+    }
+    bool found = false;
+    HuffmanNode* tree = buildCodingTree(shared);
+    flattree flat;
+    flattenTree(tree, flat);
+    freeTree(tree);
+    for (unsigned int i = 0; i < members.size(); i++) {
+        if (name != "" && members[i].name != name) continue;
+        found = true;
+        if (!safeMemberName(members[i].name)) {
+            cout << "Unsafe member name: " << members[i].name << endl;
+            return false;
+        }
+        string filename = extractedFilename(members[i].name);
+        ofstream output(filename, ios::binary);
+        if (!decodeMember(input, members[i], &flat, output)) {
+            output.close();
+            remove(filename.c_str());
+            cout << "Corrupt member: " << members[i].name << endl;
+            return false;
+        }
+    }
+    if (!found) cout << "No such member: " << name << endl;
+    return found;
+}
+
+//
+// *This function prints an archive's directory.  Returns false if the file
+// is not an archive.
+//
+inline bool archiveList(string archivename) {
+    ifstream input(archivename, ios::binary);
+    hashmapF shared;
+    vector<archivemember> members;
+    if (!readDirectory(input, shared, members)) {
+        cout << "Not an archive, or its directory is corrupt." << endl;
+        return false;
+    }
+    for (unsigned int i = 0; i < members.size(); i++) {
+        cout << members[i].rawSize << '\t' << members[i].compressedSize
+             << '\t' << members[i].name << endl;
+    }
+    return true;
+}
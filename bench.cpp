@@ -0,0 +1,138 @@
+//
+// bench.cpp
+//
+// Throughput benchmark for the coders, built against libhuff with
+// "make bench":
+//      bench.exe [--rounds <n>] <files...>
+// For each file it times the buffer codec (codec.h) and the block coder
+// (block.h, one BLOCK_DEFAULT_SIZE block at a time), checks that both round
+// trip, and prints the ratio and MB/s of each direction.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include "util.h"
+#include "codec.h"
+#include "block.h"
+
+using namespace std;
+
+//
+// *This function returns the seconds f takes to run rounds times.
+//
+template <class F>
+double timeRounds(int rounds, F f) {
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) f();
+    return chrono::duration<double>(chrono::steady_clock::now() - start)
+        .count();
+}
+
+//
+// *This function prints one result line.
+//
+void printResult(string name, string coder, size_t rawSize,
+                 size_t compressedSize, int rounds, double encodeSeconds,
+                 double decodeSeconds, bool ok) {
+    double megabytes = (double)rawSize * rounds / (1024 * 1024);
+    cout << left << setw(24) << name << setw(8) << coder << right
+         << setw(12) << rawSize << setw(12) << compressedSize << fixed
+         << setprecision(3) << setw(8)
+         << (rawSize > 0 ? (double)compressedSize / rawSize : 0.0)
+         << setprecision(1) << setw(10) << megabytes / encodeSeconds
+         << setw(10) << megabytes / decodeSeconds
+         << (ok ? "" : "  ROUND TRIP FAILED") << endl;
+    cout.unsetf(ios::fixed);
+}
+
+//
+// *This function benchmarks the buffer codec on data.  Returns false if it
+// does not round trip.
+//
+bool benchCodec(string name, const vector<unsigned char> &data, int rounds) {
+    huffcontext* ctx = new huffcontext;
+    vector<unsigned char> compressed(compressBound(data.size()));
+    vector<unsigned char> restored(data.size());
+    size_t compressedSize = 0, restoredSize = 0;
+    double encodeSeconds = timeRounds(rounds, [&]() {
+        compressedSize = compress(data.data(), data.size(),
+                                  compressed.data(), compressed.size(), *ctx);
+    });
+    double decodeSeconds = timeRounds(rounds, [&]() {
+        restoredSize = decompress(compressed.data(), compressedSize,
+                                  restored.data(), restored.size(), *ctx);
+    });
+    bool ok = restoredSize == data.size() &&
+              (data.empty() ||
+               memcmp(restored.data(), data.data(), data.size()) == 0);
+    printResult(name, "codec", data.size(), compressedSize, rounds,
+                encodeSeconds, decodeSeconds, ok);
+    delete ctx;
+    return ok;
+}
+
+//
+// *This function benchmarks the block coder on data.  Returns false if it
+// does not round trip.
+//
+bool benchBlocks(string name, const vector<unsigned char> &data,
+                 int rounds) {
+    size_t count = (data.size() + BLOCK_DEFAULT_SIZE - 1) / BLOCK_DEFAULT_SIZE;
+    vector<huffblock> blocks(count);
+    vector<unsigned char> restored, out;
+    size_t compressedSize = 0;
+    double encodeSeconds = timeRounds(rounds, [&]() {
+        compressedSize = 0;
+        for (size_t b = 0; b < count; b++) {
+            size_t start = b * BLOCK_DEFAULT_SIZE;
+            size_t n = min(data.size() - start, (size_t)BLOCK_DEFAULT_SIZE);
+            encodeBlock(data.data() + start, n, blocks[b]);
+            compressedSize += tableSize(blocks[b].table) +
+                              blocks[b].payload.size();
+        }
+    });
+    bool ok = true;
+    double decodeSeconds = timeRounds(rounds, [&]() {
+        restored.clear();
+        for (size_t b = 0; b < count; b++) {
+            ok = decodeBlock(blocks[b], out) && ok;
+            restored.insert(restored.end(), out.begin(), out.end());
+        }
+    });
+    ok = ok && restored == data;
+    printResult(name, "blocks", data.size(), compressedSize, rounds,
+                encodeSeconds, decodeSeconds, ok);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = 5;
+    vector<string> files;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "--rounds" && i + 1 < argc) {
+            rounds = max(1, atoi(argv[++i]));
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (files.empty()) {
+        cout << "usage: bench.exe [--rounds <n>] <files...>" << endl;
+        return 1;
+    }
+    cout << left << setw(24) << "file" << setw(8) << "coder" << right
+         << setw(12) << "raw" << setw(12) << "compressed" << setw(8)
+         << "ratio" << setw(10) << "enc MB/s" << setw(10) << "dec MB/s"
+         << endl;
+    bool ok = true;
+    for (unsigned int i = 0; i < files.size(); i++) {
+        vector<unsigned char> data;
+        if (!readFileBytes(files[i], data)) return 1;
+        ok = benchCodec(files[i], data, rounds) && ok;
+        ok = benchBlocks(files[i], data, rounds) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+//
+// bitbuffer.h
+//
+// In-memory counterparts of obitstream/ibitstream.  obitbuffer appends bits
+// to a byte vector and ibitbuffer reads them back, using the same bit order
+// as the bitstream classes (the first bit written is bit 0 of a byte).
+// Unlike the stream classes they move whole groups of bits at a time through
+// a 64-bit accumulator, so writing or reading a code costs a few shifts
+// instead of a seek and a put per bit.
+//
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+using namespace std;
+
+class obitbuffer {
+public:
+    obitbuffer() : acc(0), nbits(0) {}
+
+    //
+    // Writes the low n bits of value, least significant bit first.
+    // n must be at most 56.
+    //
+    void writeBits(uint64_t value, int n) {
+        acc |= value << nbits;
+        nbits += n;
+        while (nbits >= 8) {
+            data.push_back((unsigned char)acc);
+            acc >>= 8;
+            nbits -= 8;
+        }
+    }
+
+    void writeBit(int bit) {
+        writeBits(bit, 1);
+    }
+
+    //
+    // Pads the last partial byte with zeros.
+    //
+    void flush() {
+        if (nbits > 0) {
+            data.push_back((unsigned char)acc);
+            acc = 0;
+            nbits = 0;
+        }
+    }
+
+    // number of bits written so far
+    size_t bitSize() const {
+        return data.size() * 8 + nbits;
+    }
+
+    // flushes and returns the written bytes
+    vector<unsigned char>& bytes() {
+        flush();
+        return data;
+    }
+
+    // moves the whole bytes written so far into out, keeping the partial
+    // byte, so a long stream can be written out as it goes
+    void takeBytes(vector<unsigned char> &out) {
+        out.clear();
+        out.swap(data);
+    }
+
+    void clear() {
+        data.clear();
+        acc = 0;
+        nbits = 0;
+    }
+
+private:
+    vector<unsigned char> data;
+    uint64_t acc;
+    int nbits;
+};
+
+class ibitbuffer {
+public:
+    ibitbuffer(const unsigned char* data, size_t size)
+        : data(data), size(size), pos(0), acc(0), nbits(0) {}
+
+    //
+    // Reads n bits, least significant bit first.  n must be at most 56.
+    // Reading past the end returns zero bits; check overrun() afterwards.
+    //
+    uint64_t readBits(int n) {
+        if (nbits < n) refill();
+        uint64_t value = acc & ((((uint64_t)1) << n) - 1);
+        acc >>= n;
+        nbits -= n;
+        return value;
+    }
+
+    //
+    // Returns the next n bits without consuming them.  n must be at most 56.
+    //
+    uint64_t peekBits(int n) {
+        if (nbits < n) refill();
+        return acc & ((((uint64_t)1) << n) - 1);
+    }
+
+    // consumes n bits; they must have been peeked first
+    void skipBits(int n) {
+        acc >>= n;
+        nbits -= n;
+    }
+
+    int readBit() {
+        if (nbits == 0) refill();
+        int bit = (int)(acc & 1);
+        acc >>= 1;
+        nbits--;
+        return bit;
+    }
+
+    // number of bits consumed so far
+    size_t bitPosition() const {
+        return pos * 8 - nbits;
+    }
+
+    // true if more bits were read than the buffer holds
+    bool overrun() const {
+        return bitPosition() > size * 8;
+    }
+
+private:
+    void refill() {
+        while (nbits <= 56) {
+            uint64_t byte = pos < size ? data[pos] : 0;
+            acc |= byte << nbits;
+            pos++;
+            nbits += 8;
+        }
+    }
+
+    const unsigned char* data;
+    size_t size;
+    size_t pos;
+    uint64_t acc;
+    int nbits;
+};
@@ -0,0 +1,900 @@
+//
+// block.h
+//
+// The block format.  The input is cut into fixed-size blocks and each block
+// is coded on its own with whichever backend makes it smallest:
+//      BACKEND_HUFFMAN  Huffman codes from buildEncodingTree; the table is the
+//                       block's frequency map
+//      BACKEND_ANS      tANS (ans.h); the table is the normalized counts
+//      BACKEND_STORED   the raw bytes, for data that does not compress
+//      BACKEND_REPEAT   the previous block's coder and table, which is not
+//                       written again
+// Both entropy coders start from the same byte histogram.  The Huffman size
+// is exact from the code lengths and the tANS size is within a few bytes
+// from the per-symbol costs, so only the backend that wins encodes.  A block
+// whose statistics are close to the previous block's is often cheapest coded
+// with that block's table, since it saves writing one; BACKEND_REPEAT is
+// tried whenever the previous block in the frame was entropy coded.  Before
+// counting, a block may be run through one of the pre-filters in filters.h;
+// its letter follows the backend.
+//
+// A seek index after the last block lists where every block starts, both in
+// the original data and in the file, so a byte range can be read by decoding
+// only the blocks that cover it.  A fixed-size footer after the index points
+// back to it; the block size is the checkpoint interval.
+//
+// A header, its blocks, the index and the footer make up a frame.  Offsets
+// in the index are relative to the frame, so frames are self-delimiting and
+// position independent: "cat a.huf b.huf > c.huf" gives a valid file that
+// decompresses to the two inputs one after the other.
+//
+// Every record carries two CRC32Cs (checksum.h), one of the original bytes
+// and one of the payload.  The first is computed while the block's bytes are
+// counted, the second over the payload just written, so neither needs
+// another pass over the input.  Decompression checks them on request.
+//
+// File layout:
+//      #B<block size>\n
+//      <backend>[<filter>]<raw size>{table}<payload bytes>
+//          [ <raw crc> <payload crc>]\n<payload>            per block
+//      I<blocks> <raw size> <index offset>\n
+//          <raw offset> <block offset>\n ...                 index
+//      #I<bytes from index to footer, 16 digits>\n          footer
+// where both offsets in the file are relative to the frame's first byte.
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <algorithm>
+#include <unistd.h>
+#include "hashmap.h"
+#include "bitbuffer.h"
+#include "huffcode.h"
+#include "flattree.h"
+#include "ans.h"
+#include "filters.h"
+#include "checksum.h"
+#include "memory.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "util.h"
+
+using namespace std;
+
+const char BLOCK_MODE = 'B';
+const int BLOCK_DEFAULT_SIZE = 128 * 1024;
+const int BLOCK_MIN_SIZE = 16 * 1024;
+const int BLOCK_MAX_SIZE = 64 * 1024 * 1024;
+const size_t BLOCK_SLOT_COST = 6;  // bytes a pipeline slot holds per byte
+
+const char BACKEND_HUFFMAN = 'H';
+const char BACKEND_ANS = 'A';
+const char BACKEND_STORED = 'S';
+const char BACKEND_SHARED = 'P';  // Huffman with a table kept elsewhere
+const char BACKEND_REPEAT = 'R';
+
+const char INDEX_RECORD = 'I';
+const int FOOTER_SIZE = 19;
+
+struct blockindexentry {
+    size_t rawOffset;   // where the block starts in the original data
+    size_t fileOffset;  // where its record starts in the compressed file
+};
+
+//
+// The coder and table a BACKEND_REPEAT block reuses.
+//
+struct blocktable {
+    char backend;  // BACKEND_HUFFMAN or BACKEND_ANS, or 0 for none
+    hashmapF table;
+};
+
+//
+// A block record: the header fields plus the coded payload.
+//
+struct huffblock {
+    char backend;
+    char filter;  // FILTER_NONE or a letter from FILTERS
+    size_t rawSize;
+    hashmapF table;
+    vector<unsigned char> payload;
+    bool hasChecksums;
+    uint32_t rawChecksum;      // CRC32C of the original bytes
+    uint32_t payloadChecksum;  // CRC32C of the payload
+};
+
+const size_t CHECKSUM_CHUNK_SIZE = 16 * 1024;
+
+//
+// *This function counts the bytes of a block.
+//
+inline void countBytes(const unsigned char* data, size_t n,
+                       vector<int> &counts) {
+    counts.assign(ANS_SYMBOLS, 0);
+    for (size_t i = 0; i < n; i++) counts[data[i]]++;
+}
+
+//
+// *This function counts the bytes of a block and returns their CRC32C.  Both
+// are done a chunk at a time, so each chunk is read from memory once and is
+// still in cache for the second look.
+//
+inline uint32_t countBytesChecksum(const unsigned char* data, size_t n,
+                                   vector<int> &counts) {
+    counts.assign(ANS_SYMBOLS, 0);
+    uint32_t crc = 0;
+    for (size_t start = 0; start < n; start += CHECKSUM_CHUNK_SIZE) {
+        size_t end = min(n, start + CHECKSUM_CHUNK_SIZE);
+        crc = crc32c(crc, data + start, end - start);
+        for (size_t i = start; i < end; i++) counts[data[i]]++;
+    }
+    return crc;
+}
+
+//
+// *This function returns the number of characters the table takes in a block
+// header.
+//
+inline size_t tableSize(hashmapF &table) {
+    ostringstream ss;
+    ss << table;
+    return ss.str().length();
+}
+
+//
+// *This function Huffman codes a block with codes built from its counts.
+//
+inline void huffmanEncodeBlock(const unsigned char* data, size_t n,
+                               const vector<HuffmanCode> &codes,
+                               obitbuffer &output) {
+    for (size_t i = 0; i < n; i++) writeSymbol(output, codes, data[i]);
+}
+
+//
+// What encoding a block works out before it picks a backend: the bytes to
+// code (after the pre-filter) and the size of every candidate.
+//
+struct blockplan {
+    const unsigned char* data;
+    size_t n;
+    vector<unsigned char> filtered;
+    vector<int> counts;
+    hashmapF frequencyMap;
+    vector<HuffmanCode> codes;
+    size_t huffmanSize;
+    vector<int> norm;
+    hashmapF normMap;
+    size_t ansSize;
+    char repeatBackend;        // the coder a BACKEND_REPEAT block uses
+    vector<int> repeatCounts;  // the repeated table as counts
+    vector<HuffmanCode> repeatCodes;
+    size_t codedSize;          // table and payload of the chosen backend
+};
+
+//
+// *This function prepares a block for coding: it applies the pre-filter
+// chooseFilter picks, counts the bytes, computes the checksum and sizes the
+// Huffman and tANS candidates.  data must stay valid until codeBlock.
+//
+inline void planBlock(const unsigned char* data, size_t n, huffblock &block,
+                      blockplan &plan) {
+    block.rawSize = n;
+    block.table = hashmapF();
+    block.payload.clear();
+    block.filter = chooseFilter(data, n);
+    block.hasChecksums = true;
+    if (block.filter != FILTER_NONE) {
+        block.rawChecksum = crc32c(0, data, n);
+        plan.filtered.resize(n);
+        applyFilter(*findFilter(block.filter), data, n, plan.filtered.data());
+        data = plan.filtered.data();
+        countBytes(data, n, plan.counts);
+    } else {
+        block.rawChecksum = countBytesChecksum(data, n, plan.counts);
+    }
+    plan.data = data;
+    plan.n = n;
+    const vector<int> &counts = plan.counts;
+
+    // Huffman: exact size from the code lengths
+    plan.frequencyMap = hashmapF();
+    buildFrequencyMap(counts, plan.frequencyMap);
+    HuffmanNode* tree = buildCodingTree(plan.frequencyMap);
+    plan.codes = buildCodeTable(tree, ANS_SYMBOLS);
+    freeTree(tree);
+    size_t huffmanBits = 0;
+    for (int s = 0; s < ANS_SYMBOLS; s++) {
+        huffmanBits += (size_t)counts[s] * plan.codes[s].length;
+    }
+    plan.huffmanSize = tableSize(plan.frequencyMap) + (huffmanBits + 7) / 8;
+
+    // tANS: size from the per-symbol costs
+    normalizeCounts(counts, ANS_TABLE_LOG, plan.norm);
+    plan.normMap = hashmapF();
+    buildFrequencyMap(plan.norm, plan.normMap);
+    plan.ansSize = tableSize(plan.normMap) +
+                   ansEncodedSize(counts, plan.norm, ANS_TABLE_LOG);
+}
+
+//
+// *This function picks the cheapest backend for a planned block and sets
+// its table.  previous is what a BACKEND_REPEAT block would reuse, or
+// nullptr; it is only read here, so blocks can be planned and coded in
+// parallel as long as their backends are chosen in order.
+//
+inline void chooseBackend(blockplan &plan, huffblock &block,
+                          blocktable* previous) {
+    const vector<int> &counts = plan.counts;
+    size_t n = plan.n;
+
+    // repeat: the previous block's coder and table, if the table has every
+    // byte that occurs
+    size_t repeatSize = (size_t)-1;
+    plan.repeatCounts.assign(ANS_SYMBOLS, 0);
+    bool covered = previous != nullptr && previous->backend != 0 && n > 0;
+    if (covered) {
+        vector<int> keys = previous->table.keys();
+        for (unsigned int i = 0; i < keys.size(); i++) {
+            plan.repeatCounts[keys[i]] = previous->table.get(keys[i]);
+        }
+    }
+    for (int s = 0; s < ANS_SYMBOLS && covered; s++) {
+        covered = counts[s] == 0 || plan.repeatCounts[s] > 0;
+    }
+    if (covered && previous->backend == BACKEND_ANS) {
+        repeatSize = 2 + ansEncodedSize(counts, plan.repeatCounts,
+                                        ANS_TABLE_LOG);
+    } else if (covered) {
+        HuffmanNode* repeatTree = buildCodingTree(previous->table);
+        plan.repeatCodes = buildCodeTable(repeatTree, ANS_SYMBOLS);
+        freeTree(repeatTree);
+        size_t bits = 0;
+        for (int s = 0; s < ANS_SYMBOLS; s++) {
+            bits += (size_t)counts[s] * plan.repeatCodes[s].length;
+        }
+        repeatSize = 2 + (bits + 7) / 8;
+    }
+
+    size_t storedSize = 2 + n;  // "{}" and the bytes
+    size_t huffmanSize = plan.huffmanSize, ansSize = plan.ansSize;
+    if (storedSize <= huffmanSize && storedSize <= ansSize &&
+        storedSize <= repeatSize) {
+        block.backend = BACKEND_STORED;
+        plan.codedSize = storedSize;
+    } else if (repeatSize < huffmanSize && repeatSize <= ansSize) {
+        block.backend = BACKEND_REPEAT;
+        plan.repeatBackend = previous->backend;
+        plan.codedSize = repeatSize;
+    } else if (ansSize < huffmanSize) {
+        block.backend = BACKEND_ANS;
+        block.table = plan.normMap;
+        plan.codedSize = ansSize;
+    } else {
+        block.backend = BACKEND_HUFFMAN;
+        block.table = plan.frequencyMap;
+        plan.codedSize = huffmanSize;
+    }
+}
+
+//
+// *This function codes a planned block's payload with the backend
+// chooseBackend picked.
+//
+inline void codeBlock(blockplan &plan, huffblock &block) {
+    const unsigned char* data = plan.data;
+    size_t n = plan.n;
+    obitbuffer bits;
+    if (block.backend == BACKEND_STORED) {
+        block.payload.assign(data, data + n);
+    } else if (block.backend == BACKEND_REPEAT &&
+               plan.repeatBackend == BACKEND_ANS) {
+        ansEncode(data, n, plan.repeatCounts, ANS_TABLE_LOG, bits);
+        block.payload.swap(bits.bytes());
+    } else if (block.backend == BACKEND_REPEAT) {
+        huffmanEncodeBlock(data, n, plan.repeatCodes, bits);
+        block.payload.swap(bits.bytes());
+    } else if (block.backend == BACKEND_ANS) {
+        ansEncode(data, n, plan.norm, ANS_TABLE_LOG, bits);
+        block.payload.swap(bits.bytes());
+    } else {
+        huffmanEncodeBlock(data, n, plan.codes, bits);
+        block.payload.swap(bits.bytes());
+    }
+    block.payloadChecksum = crc32c(0, block.payload.data(),
+                                   block.payload.size());
+}
+
+//
+// *This function codes one block with the cheapest backend, after the
+// pre-filter chooseFilter picks for it.  previous is what a BACKEND_REPEAT
+// block would reuse, or nullptr.
+//
+inline void encodeBlock(const unsigned char* data, size_t n, huffblock &block,
+                        blocktable* previous = nullptr) {
+    blockplan plan;
+    planBlock(data, n, block, plan);
+    chooseBackend(plan, block, previous);
+    codeBlock(plan, block);
+}
+
+//
+// *This function keeps in previous what the block after block may repeat.
+//
+inline void keepTable(const huffblock &block, blocktable &previous) {
+    if (block.backend == BACKEND_REPEAT) return;
+    bool coded = block.backend == BACKEND_HUFFMAN ||
+                 block.backend == BACKEND_ANS;
+    previous.backend = coded ? block.backend : 0;
+    previous.table = coded ? block.table : hashmapF();
+}
+
+//
+// *This function gives a BACKEND_REPEAT block the coder and table it
+// repeats, and keeps what the next block may repeat in previous.  Call it on
+// every block of a frame in order, after writing or reading it.  Returns
+// false if a block repeats a table there is none of.
+//
+inline bool resolveTable(huffblock &block, blocktable &previous) {
+    if (block.backend == BACKEND_REPEAT) {
+        if (previous.backend == 0) return false;
+        block.backend = previous.backend;
+        block.table = previous.table;
+        return true;
+    }
+    keepTable(block, previous);
+    return true;
+}
+
+//
+// *This function decodes a block's payload into out.  shared is the
+// flattened tree of the table BACKEND_SHARED blocks are coded with, if there
+// is one.  Returns false if it is corrupt.
+//
+inline bool decodePayload(huffblock &block, vector<unsigned char> &out,
+                          const flattree* shared = nullptr) {
+    out.resize(block.rawSize);
+    if (block.backend == BACKEND_STORED) {
+        if (block.payload.size() != block.rawSize) return false;
+        out.assign(block.payload.begin(), block.payload.end());
+        return true;
+    }
+    if (block.rawSize == 0) return true;
+    if (block.backend == BACKEND_SHARED) {
+        if (shared == nullptr || flatEmpty(*shared)) return false;
+        ibitbuffer bits(block.payload.data(), block.payload.size());
+        unsigned char* dst = out.data();
+        for (size_t i = 0; i < block.rawSize; i++) {
+            dst[i] = (unsigned char)readSymbol(bits, *shared);
+        }
+        return !bits.overrun();
+    }
+
+    vector<int> counts(ANS_SYMBOLS, 0);
+    vector<int> keys = block.table.keys();
+    for (unsigned int i = 0; i < keys.size(); i++) {
+        if (keys[i] < 0 || keys[i] >= ANS_SYMBOLS) return false;
+        counts[keys[i]] = block.table.get(keys[i]);
+    }
+    ibitbuffer bits(block.payload.data(), block.payload.size());
+    if (block.backend == BACKEND_ANS) {
+        int sum = 0;
+        for (int s = 0; s < ANS_SYMBOLS; s++) sum += counts[s];
+        if (sum != 1 << ANS_TABLE_LOG) return false;
+        return ansDecode(bits, block.rawSize, counts, ANS_TABLE_LOG,
+                         out.data());
+    }
+    if (block.backend != BACKEND_HUFFMAN) return false;
+    HuffmanNode* tree = buildCodingTree(block.table);
+    flattree flat;
+    bool flattened = flattenTree(tree, flat);
+    freeTree(tree);
+    if (!flattened) return false;
+    unsigned char* dst = out.data();
+    for (size_t i = 0; i < block.rawSize; i++) {
+        dst[i] = (unsigned char)readSymbol(bits, flat);
+    }
+    return !bits.overrun();
+}
+
+//
+// *This function decodes a block into out and undoes its pre-filter.  With
+// verify, the payload checksum is checked before decoding and the original
+// bytes' checksum after.  shared is passed on to decodePayload.  Returns
+// false if the block is corrupt.
+//
+inline bool decodeBlock(huffblock &block, vector<unsigned char> &out,
+                        bool verify = false, const flattree* shared = nullptr) {
+    const filterspec* filter = nullptr;
+    if (block.filter != FILTER_NONE) {
+        filter = findFilter(block.filter);
+        if (filter == nullptr) return false;
+    }
+    verify = verify && block.hasChecksums;
+    if (verify && crc32c(0, block.payload.data(), block.payload.size()) !=
+                  block.payloadChecksum) {
+        return false;
+    }
+    if (!decodePayload(block, out, shared)) return false;
+    if (filter != nullptr) undoFilter(*filter, out);
+    return !verify || crc32c(0, out.data(), out.size()) == block.rawChecksum;
+}
+
+//
+// *This function writes a block record to output.
+//
+inline void writeBlock(ostream &output, huffblock &block) {
+    output << block.backend;
+    if (block.filter != FILTER_NONE) output << block.filter;
+    output << block.rawSize << block.table << block.payload.size();
+    if (block.hasChecksums) {
+        output << ' ' << hex << block.rawChecksum << ' '
+               << block.payloadChecksum << dec;
+    }
+    output << '\n';
+    writeBytes(output, block.payload.data(), block.payload.size());
+}
+
+//
+// *This function reads the next block record from input, in a frame whose
+// blocks hold at most blockSize bytes.  Returns false at the end of the
+// file or if the record is malformed; sizes are checked before anything is
+// allocated for them.
+//
+inline bool readBlock(istream &input, huffblock &block, size_t blockSize) {
+    int backend = input.get();
+    if (backend == EOF) return false;
+    block.backend = (char)backend;
+    block.filter = FILTER_NONE;
+    if (isalpha(input.peek())) block.filter = (char)input.get();
+    block.table = hashmapF();
+    size_t payloadSize = 0;
+    if (!(input >> block.rawSize) || block.rawSize > blockSize ||
+        !readFrequencyMap(input, block.table) || !(input >> payloadSize)) {
+        return false;
+    }
+    block.hasChecksums = input.peek() == ' ';
+    if (block.hasChecksums) {
+        input >> hex >> block.rawChecksum >> block.payloadChecksum >> dec;
+    }
+    if (input.get() != '\n' || payloadSize > bytesLeft(input)) return false;
+    block.payload.resize(payloadSize);
+    if (payloadSize > 0) input.read((char*)&block.payload[0], payloadSize);
+    return (bool)input;
+}
+
+//
+// *This function reads a frame header.  Returns false if input is not at the
+// start of a block frame.
+//
+inline bool readFrameHeader(istream &input, int &blockSize) {
+    return input.get() == HEADER_TAG && input.get() == BLOCK_MODE &&
+           (input >> blockSize) && blockSize >= 1 &&
+           blockSize <= BLOCK_MAX_SIZE && input.get() == '\n';
+}
+
+//
+// *This function writes a frame's seek index and the footer that points to
+// it.  Block offsets are written relative to frameStart.
+//
+inline void writeBlockIndex(ostream &output,
+                            const vector<blockindexentry> &index,
+                            size_t rawSize, size_t frameStart) {
+    size_t indexOffset = (size_t)output.tellp();
+    output << INDEX_RECORD << index.size() << ' ' << rawSize << ' '
+           << indexOffset - frameStart << '\n';
+    for (unsigned int i = 0; i < index.size(); i++) {
+        output << index[i].rawOffset << ' '
+               << index[i].fileOffset - frameStart << '\n';
+    }
+    size_t footerOffset = (size_t)output.tellp();
+    output << HEADER_TAG << INDEX_RECORD << setw(FOOTER_SIZE - 3)
+           << setfill('0') << footerOffset - indexOffset << setfill(' ')
+           << '\n';
+}
+
+//
+// *This function reads an index record (the INDEX_RECORD letter included)
+// and the footer after it.  Offsets are left relative to the frame start,
+// which is indexOffset bytes before the record.  Returns false if it is
+// malformed.
+//
+inline bool readIndexRecord(istream &input, vector<blockindexentry> &index,
+                            size_t &rawSize, size_t &indexOffset) {
+    size_t count = 0;
+    if (input.get() != INDEX_RECORD ||
+        !(input >> count >> rawSize >> indexOffset) ||
+        count > bytesLeft(input)) {
+        return false;
+    }
+    index.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        input >> index[i].rawOffset >> index[i].fileOffset;
+    }
+    input.get();  // newline
+    char footer[FOOTER_SIZE];
+    input.read(footer, FOOTER_SIZE);
+    return input && footer[0] == HEADER_TAG && footer[1] == INDEX_RECORD;
+}
+
+//
+// *This function loads the seek index of a block file, with absolute file
+// offsets.  Frames are found from the end of the file: each footer leads to
+// its frame's index, and the index to the frame's start, where the previous
+// frame's footer ends.  Files whose frames lack footers are indexed by
+// scanning their block records.  Returns false if the file is not a block
+// file.
+//
+inline bool readBlockIndex(istream &input, vector<blockindexentry> &index,
+                           size_t &rawSize) {
+    index.clear();
+    rawSize = 0;
+    input.seekg(0, ios::end);
+    long frameEnd = (long)input.tellg();
+    vector<vector<blockindexentry> > frames;  // last frame first
+    vector<size_t> frameSizes;
+    while (frameEnd >= FOOTER_SIZE) {
+        char footer[FOOTER_SIZE + 1] = {0};
+        input.seekg(frameEnd - FOOTER_SIZE);
+        input.read(footer, FOOTER_SIZE);
+        if (footer[0] != HEADER_TAG || footer[1] != INDEX_RECORD) break;
+        long indexPos = frameEnd - FOOTER_SIZE - atol(footer + 2);
+        vector<blockindexentry> frame;
+        size_t frameRaw = 0, indexOffset = 0;
+        input.seekg(indexPos);
+        if (indexPos < 0 ||
+            !readIndexRecord(input, frame, frameRaw, indexOffset) ||
+            (long)indexOffset > indexPos) {
+            break;
+        }
+        long frameStart = indexPos - (long)indexOffset;
+        for (unsigned int i = 0; i < frame.size(); i++) {
+            frame[i].fileOffset += frameStart;
+        }
+        frames.push_back(frame);
+        frameSizes.push_back(frameRaw);
+        frameEnd = frameStart;
+    }
+    input.clear();
+    if (!frames.empty() && frameEnd == 0) {
+        for (size_t f = frames.size(); f-- > 0;) {
+            for (unsigned int i = 0; i < frames[f].size(); i++) {
+                frames[f][i].rawOffset += rawSize;
+                index.push_back(frames[f][i]);
+            }
+            rawSize += frameSizes[f];
+        }
+        return true;
+    }
+
+    // no usable footers: scan the records of every frame
+    input.seekg(0);
+    int blockSize = 0;
+    huffblock block;
+    while (input.peek() != EOF) {
+        if (!readFrameHeader(input, blockSize)) return false;
+        while (input.peek() != EOF && input.peek() != HEADER_TAG &&
+               input.peek() != INDEX_RECORD) {
+            blockindexentry entry = {rawSize, (size_t)input.tellg()};
+            if (!readBlock(input, block, blockSize)) return false;
+            index.push_back(entry);
+            rawSize += block.rawSize;
+        }
+        vector<blockindexentry> skipped;
+        size_t skippedRaw = 0, indexOffset = 0;
+        if (input.peek() == INDEX_RECORD &&
+            !readIndexRecord(input, skipped, skippedRaw, indexOffset)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// A block buffer in the encoding pipeline.
+//
+struct blockslot {
+    vector<unsigned char, trackedallocator<unsigned char, MEMORY_BLOCKS> > data;
+    size_t n;
+    size_t rawOffset;
+    blockplan plan;
+    huffblock block;
+};
+
+//
+// *This function fits the encoding pipeline into budget bytes, 0 for no
+// limit.  Each slot holds about BLOCK_SLOT_COST times blockSize (the input,
+// a filtered copy, the payload), so it lowers workers first, down to one,
+// and then blockSize, not below BLOCK_MIN_SIZE.  blockSize 0 means
+// BLOCK_DEFAULT_SIZE and workers 0 means workerCount().
+//
+inline void fitBlockBudget(size_t budget, int &blockSize, int &workers) {
+    if (blockSize < 1) blockSize = BLOCK_DEFAULT_SIZE;
+    if (workers < 1) workers = workerCount();
+    if (budget == 0) return;
+    while (workers > 1 && (size_t)pipelineSlots(workers) * BLOCK_SLOT_COST *
+                              blockSize > budget) {
+        workers--;
+    }
+    size_t largest = budget / (pipelineSlots(workers) * BLOCK_SLOT_COST);
+    if ((size_t)blockSize > largest) {
+        blockSize = max((int)largest, BLOCK_MIN_SIZE);
+    }
+}
+
+//
+// *This function reads blocks from input until it ends, encodes them and
+// writes them to output.  Each block gets an index entry; rawSize is the
+// frame's uncompressed size so far and is advanced.  Reading, coding and
+// writing run as a pipeline (pipeline.h) with workers encoders, or
+// workerCount() if it is 0; backends are chosen in block order, so the
+// output is the same as coding the blocks one by one.
+//
+inline void encodeBlocks(istream &input, ostream &output, int blockSize,
+                         vector<blockindexentry> &index, size_t &rawSize,
+                         int workers = 0) {
+    blocktable previous = {0, hashmapF()};
+    size_t readSize = rawSize;
+    pipelinestages<blockslot> stages;
+    stages.read = [&](blockslot &slot) {
+        slot.data.resize(blockSize);
+        input.read((char*)slot.data.data(), blockSize);
+        slot.n = (size_t)input.gcount();
+        slot.rawOffset = readSize;
+        readSize += slot.n;
+        return slot.n > 0;
+    };
+    stages.prepare = [&](blockslot &slot) {
+        planBlock(slot.data.data(), slot.n, slot.block, slot.plan);
+    };
+    stages.order = [&](blockslot &slot) {
+        chooseBackend(slot.plan, slot.block, &previous);
+        keepTable(slot.block, previous);
+    };
+    stages.finish = [&](blockslot &slot) {
+        codeBlock(slot.plan, slot.block);
+    };
+    stages.write = [&](blockslot &slot) {
+        blockindexentry entry = {slot.rawOffset, (size_t)output.tellp()};
+        index.push_back(entry);
+        writeBlock(output, slot.block);
+        rawSize += slot.n;
+    };
+    runPipeline(stages, workers > 0 ? workers : workerCount());
+}
+
+//
+// *This function compresses filename into (filename + ".huf") as one block
+// frame: a header, the blocks, and a seek index with one checkpoint per
+// block.  Frames are self-delimiting, so compressed shards can simply be
+// concatenated.  workers is passed to encodeBlocks.  Returns the compressed
+// size in bytes, or -1 on error.
+//
+inline long blockCompress(string filename, int blockSize, int workers = 0) {
+    ifstream input(filename, ios::binary);
+    if (!input.is_open()) {
+        cout << "File does not exist." << endl;
+        return -1;
+    }
+    if (blockSize < 1) blockSize = BLOCK_DEFAULT_SIZE;
+    blockSize = min(blockSize, BLOCK_MAX_SIZE);
+    ofstream output(filename + ".huf", ios::binary);
+    output << HEADER_TAG << BLOCK_MODE << blockSize << '\n';
+    vector<blockindexentry> index;
+    size_t rawSize = 0;
+    encodeBlocks(input, output, blockSize, index, rawSize, workers);
+    writeBlockIndex(output, index, rawSize, 0);
+    long size = (long)output.tellp();
+    output.close();
+    return size;
+}
+
+//
+// *This function appends the part of filename that was added since
+// (filename + ".huf") was written.  The new blocks go into the file's last
+// frame where its index used to be, and a new index and footer are written
+// after them, so the cost is proportional to the new data.  A partial last
+// block is re-encoded together with the new data so blocks stay full.  If
+// there is no .huf file yet, the whole file is compressed.  workers is
+// passed to encodeBlocks.  Returns the number of compressed bytes written,
+// or -1 on error.
+//
+inline long blockAppend(string filename, int blockSize, int workers = 0) {
+    string hufname = filename + ".huf";
+    ifstream exists(hufname, ios::binary);
+    if (!exists.is_open()) return blockCompress(filename, blockSize, workers);
+    exists.close();
+
+    fstream file(hufname, ios::in | ios::out | ios::binary);
+    vector<blockindexentry> all;
+    size_t totalRaw = 0;
+    if (!readBlockIndex(file, all, totalRaw)) {
+        cout << "Not a block file." << endl;
+        return -1;
+    }
+    // find the last frame through its footer
+    file.clear();
+    file.seekg(0, ios::end);
+    long fileSize = (long)file.tellg();
+    char footer[FOOTER_SIZE + 1] = {0};
+    if (fileSize >= FOOTER_SIZE) {
+        file.seekg(fileSize - FOOTER_SIZE);
+        file.read(footer, FOOTER_SIZE);
+    }
+    if (footer[0] != HEADER_TAG || footer[1] != INDEX_RECORD) {
+        cout << "Block file has no index; compress it again." << endl;
+        return -1;
+    }
+    long indexPos = fileSize - FOOTER_SIZE - atol(footer + 2);
+    vector<blockindexentry> index;
+    size_t frameRaw = 0, indexOffset = 0;
+    int frameBlockSize = 0;
+    file.seekg(indexPos);
+    bool ok = readIndexRecord(file, index, frameRaw, indexOffset);
+    long frameStart = indexPos - (long)indexOffset;
+    file.seekg(frameStart);
+    if (!ok || !readFrameHeader(file, frameBlockSize)) {
+        cout << "Corrupt block index." << endl;
+        return -1;
+    }
+    for (unsigned int i = 0; i < index.size(); i++) {
+        index[i].fileOffset += frameStart;
+    }
+
+    ifstream input(filename, ios::binary);
+    input.seekg(0, ios::end);
+    if (!input.is_open() || (size_t)input.tellg() < totalRaw) {
+        cout << "File is shorter than its compressed copy." << endl;
+        return -1;
+    }
+    // resume after the last full block
+    size_t frameRawBase = totalRaw - frameRaw;
+    long writePos = indexPos;
+    if (!index.empty() &&
+        frameRaw - index.back().rawOffset < (size_t)frameBlockSize) {
+        writePos = (long)index.back().fileOffset;
+        frameRaw = index.back().rawOffset;
+        index.pop_back();
+    }
+    input.seekg(frameRawBase + frameRaw);
+    file.clear();
+    file.seekp(writePos);
+    encodeBlocks(input, file, frameBlockSize, index, frameRaw, workers);
+    writeBlockIndex(file, index, frameRaw, frameStart);
+    long end = (long)file.tellp();
+    file.close();
+    if (truncate(hufname.c_str(), end) != 0) {
+        cout << "Cannot truncate " << hufname << endl;
+        return -1;
+    }
+    return end - writePos;
+}
+
+//
+// *This function decompresses a file of one or more block frames, such as
+// the concatenation of several blockCompress outputs, to the concatenation
+// of their data.  The output is named the same way decompress names it.
+// With verify, block checksums are checked.  Returns false if the file is
+// corrupt.
+//
+inline bool blockDecompress(string filename, bool verify = false) {
+    ifstream input(filename.substr(0, filename.find(".huf")) + ".huf",
+                   ios::binary);
+    int blockSize = 0;
+    if (!readFrameHeader(input, blockSize)) {
+        cout << "Not a block file." << endl;
+        return false;
+    }
+    ofstream output(uncompressedFilename(filename), ios::binary);
+    huffblock block;
+    blocktable previous = {0, hashmapF()};
+    vector<unsigned char> out;
+    vector<blockindexentry> index;
+    size_t rawSize = 0, indexOffset = 0;
+    while (true) {
+        while (input.peek() != EOF && input.peek() != HEADER_TAG &&
+               input.peek() != INDEX_RECORD) {
+            if (!readBlock(input, block, blockSize) ||
+                !resolveTable(block, previous) ||
+                !decodeBlock(block, out, verify)) {
+                cout << "Corrupt block data." << endl;
+                return false;
+            }
+            writeBytes(output, out.data(), out.size());
+        }
+        // end of this frame; another may follow
+        if (input.peek() == INDEX_RECORD &&
+            !readIndexRecord(input, index, rawSize, indexOffset)) {
+            cout << "Corrupt block index." << endl;
+            return false;
+        }
+        if (input.peek() == EOF) break;
+        previous.backend = 0;
+        if (!readFrameHeader(input, blockSize)) {
+            cout << "Corrupt block frame." << endl;
+            return false;
+        }
+    }
+    output.close();
+    return true;
+}
+
+//
+// *This function decodes only the blocks that cover bytes [offset, offset +
+// length) of the original file and appends those bytes to out.  Returns
+// false if the file is corrupt or the range is past the end.
+//
+inline bool blockDecompressRange(istream &input, size_t offset, size_t length,
+                                 vector<unsigned char> &out,
+                                 bool verify = false) {
+    vector<blockindexentry> index;
+    size_t rawSize = 0;
+    if (!readBlockIndex(input, index, rawSize) || offset > rawSize) {
+        return false;
+    }
+    // offset <= rawSize, so this cannot wrap as offset + length can
+    size_t end = length > rawSize - offset ? rawSize : offset + length;
+    // the last checkpoint at or before offset
+    size_t first = upper_bound(index.begin(), index.end(), offset,
+                               [](size_t value, const blockindexentry &e) {
+                                   return value < e.rawOffset;
+                               }) - index.begin();
+    first = first > 0 ? first - 1 : 0;
+    huffblock block;
+    blocktable previous = {0, hashmapF()};
+    vector<unsigned char> decoded;
+    input.clear();
+    // a repeated table is in the last block before first that is not a
+    // repeat; the frame's first block never is one
+    size_t owner = first;
+    while (owner > 0) {
+        input.seekg(index[owner - 1].fileOffset);
+        if (!readBlock(input, block, BLOCK_MAX_SIZE)) return false;
+        if (block.backend != BACKEND_REPEAT) {
+            resolveTable(block, previous);
+            break;
+        }
+        owner--;
+    }
+    for (size_t i = first; i < index.size() && index[i].rawOffset < end;
+         i++) {
+        // frames may differ in block size, so only the largest is known
+        input.seekg(index[i].fileOffset);
+        if (!readBlock(input, block, BLOCK_MAX_SIZE) ||
+            !resolveTable(block, previous) ||
+            !decodeBlock(block, decoded, verify)) {
+            return false;
+        }
+        size_t from = max(offset, index[i].rawOffset) - index[i].rawOffset;
+        size_t to = min(end, index[i].rawOffset + decoded.size()) -
+                    index[i].rawOffset;
+        out.insert(out.end(), decoded.begin() + from, decoded.begin() + to);
+    }
+    return true;
+}
+
+//
+// *This function writes bytes [offset, offset + length) of the original file
+// to the file decompress would write.  Returns false if the file is corrupt.
+//
+inline bool blockDecompressRange(string filename, size_t offset, size_t length,
+                                 bool verify = false) {
+    ifstream input(filename.substr(0, filename.find(".huf")) + ".huf",
+                   ios::binary);
+    vector<unsigned char> out;
+    if (!input.is_open() ||
+        !blockDecompressRange(input, offset, length, out, verify)) {
+        cout << "Cannot read range from block file." << endl;
+        return false;
+    }
+    ofstream output(uncompressedFilename(filename), ios::binary);
+    writeBytes(output, out.data(), out.size());
+    output.close();
+    return true;
+}
@@ -0,0 +1,473 @@
+//
+// bwt.h
+//
+// A block-sorting mode for highly redundant text.  Each block goes through
+//      1. a Burrows-Wheeler transform, using an SA-IS suffix array,
+//      2. move-to-front coding, which turns the BWT's runs into zeros,
+//      3. zero-run-length coding with the RUNA/RUNB symbols of bzip2,
+//      4. Huffman coding with a tree from buildEncodingTree.
+// Blocks are independent, so they are compressed and decompressed in
+// parallel.
+//
+// MTF/RLE alphabet: RUNA = 0, RUNB = 1, MTF value v >= 1 is symbol v + 1,
+// skipping PSEUDO_EOF and NOT_A_CHAR; PSEUDO_EOF ends the block.
+//
+// File layout:
+//      #W<block size>\n
+//      <raw size> <primary index>{map}<payload bytes>\n<payload>   per block
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include "hashmap.h"
+#include "bitbuffer.h"
+#include "huffcode.h"
+#include "parallel.h"
+#include "util.h"
+
+using namespace std;
+
+const char BWT_MODE = 'W';
+const int BWT_DEFAULT_BLOCK_SIZE = 900 * 1024;
+const int BWT_MIN_BLOCK_SIZE = 64 * 1024;
+const int BWT_MAX_BLOCK_SIZE = 64 * 1024 * 1024;
+const size_t BWT_BLOCK_COST = 14;  // bytes a block in flight holds per byte
+const int BWT_RUNA = 0;
+const int BWT_RUNB = 1;
+const int BWT_SYMBOLS = NOT_A_CHAR + 2;
+
+//
+// *This function returns the symbol for MTF value v (1 to 255).
+//
+inline int bwtSymbol(int v) {
+    int symbol = v + 1;
+    return symbol >= PSEUDO_EOF ? symbol + 2 : symbol;
+}
+
+//
+// *This function is the inverse of bwtSymbol.
+//
+inline int bwtValue(int symbol) {
+    return (symbol > NOT_A_CHAR ? symbol - 2 : symbol) - 1;
+}
+
+//
+// *Helper for sais: finds the start (or end) of each symbol's bucket.
+//
+inline void _saisBuckets(const int* s, int n, int K, vector<int> &bkt,
+                         bool end) {
+    fill(bkt.begin(), bkt.end(), 0);
+    for (int i = 0; i < n; i++) bkt[s[i]]++;
+    int sum = 0;
+    for (int k = 0; k < K; k++) {
+        sum += bkt[k];
+        bkt[k] = end ? sum : sum - bkt[k];
+    }
+}
+
+//
+// *Helper for sais: induces the order of L-type (and then S-type) suffixes
+// from the suffixes already placed in sa.
+//
+inline void _saisInduce(const int* s, int* sa, const vector<char> &t, int n,
+                        int K, vector<int> &bkt) {
+    _saisBuckets(s, n, K, bkt, false);
+    for (int i = 0; i < n; i++) {
+        int j = sa[i] - 1;
+        if (sa[i] > 0 && !t[j]) sa[bkt[s[j]]++] = j;
+    }
+    _saisBuckets(s, n, K, bkt, true);
+    for (int i = n - 1; i >= 0; i--) {
+        int j = sa[i] - 1;
+        if (sa[i] > 0 && t[j]) sa[--bkt[s[j]]] = j;
+    }
+}
+
+//
+// *This function builds the suffix array of s with the SA-IS algorithm.
+// s has n symbols in [0, K) and must end with a unique 0 sentinel.
+//
+inline void sais(const int* s, int* sa, int n, int K) {
+    if (n == 1) {
+        sa[0] = 0;
+        return;
+    }
+    // t[i] is true for S-type suffixes
+    vector<char> t(n);
+    t[n - 1] = 1;
+    for (int i = n - 2; i >= 0; i--) {
+        t[i] = s[i] < s[i + 1] || (s[i] == s[i + 1] && t[i + 1]);
+    }
+    #define IS_LMS(i) ((i) > 0 && t[i] && !t[(i) - 1])
+
+    // 1. sort the LMS substrings
+    vector<int> bkt(K);
+    _saisBuckets(s, n, K, bkt, true);
+    for (int i = 0; i < n; i++) sa[i] = -1;
+    for (int i = 1; i < n; i++) {
+        if (IS_LMS(i)) sa[--bkt[s[i]]] = i;
+    }
+    _saisInduce(s, sa, t, n, K, bkt);
+
+    // 2. name them; equal substrings get equal names
+    int n1 = 0;
+    for (int i = 0; i < n; i++) {
+        if (IS_LMS(sa[i])) sa[n1++] = sa[i];
+    }
+    for (int i = n1; i < n; i++) sa[i] = -1;
+    int name = 0, prev = -1;
+    for (int i = 0; i < n1; i++) {
+        int pos = sa[i];
+        bool diff = false;
+        for (int d = 0; d < n; d++) {
+            if (prev == -1 || s[pos + d] != s[prev + d] ||
+                t[pos + d] != t[prev + d]) {
+                diff = true;
+                break;
+            } else if (d > 0 && (IS_LMS(pos + d) || IS_LMS(prev + d))) {
+                break;
+            }
+        }
+        if (diff) {
+            name++;
+            prev = pos;
+        }
+        sa[n1 + pos / 2] = name - 1;
+    }
+    for (int i = n - 1, j = n - 1; i >= n1; i--) {
+        if (sa[i] >= 0) sa[j--] = sa[i];
+    }
+
+    // 3. sort the reduced problem, recursing if names are not unique
+    int* s1 = sa + n - n1;
+    if (name < n1) {
+        sais(s1, sa, n1, name);
+    } else {
+        for (int i = 0; i < n1; i++) sa[s1[i]] = i;
+    }
+
+    // 4. induce the full suffix array from the sorted LMS suffixes
+    _saisBuckets(s, n, K, bkt, true);
+    for (int i = 1, j = 0; i < n; i++) {
+        if (IS_LMS(i)) s1[j++] = i;
+    }
+    for (int i = 0; i < n1; i++) sa[i] = s1[sa[i]];
+    for (int i = n1; i < n; i++) sa[i] = -1;
+    for (int i = n1 - 1; i >= 0; i--) {
+        int j = sa[i];
+        sa[i] = -1;
+        sa[--bkt[s[j]]] = j;
+    }
+    _saisInduce(s, sa, t, n, K, bkt);
+    #undef IS_LMS
+}
+
+//
+// *This function computes the Burrows-Wheeler transform of n bytes.  The
+// transform of data plus an end sentinel has n + 1 characters; out receives
+// the n real ones and the row holding the sentinel is returned.
+//
+inline int bwtForward(const unsigned char* data, int n, unsigned char* out) {
+    vector<int> s(n + 1), sa(n + 1);
+    for (int i = 0; i < n; i++) s[i] = data[i] + 1;
+    s[n] = 0;
+    sais(s.data(), sa.data(), n + 1, 257);
+    int primary = 0;
+    for (int i = 0, j = 0; i <= n; i++) {
+        if (sa[i] == 0) {
+            primary = i;
+        } else {
+            out[j++] = data[sa[i] - 1];
+        }
+    }
+    return primary;
+}
+
+//
+// *This function inverts bwtForward.  Returns false if primary is out of
+// range.
+//
+inline bool bwtInverse(const unsigned char* in, int n, int primary,
+                       unsigned char* out) {
+    if (primary < 0 || primary > n) return false;
+    // LF mapping over the n + 1 rows; the sentinel sorts first
+    vector<int> C(256, 0);
+    for (int i = 0; i < n; i++) C[in[i]]++;
+    int sum = 1;
+    for (int c = 0; c < 256; c++) {
+        int count = C[c];
+        C[c] = sum;
+        sum += count;
+    }
+    vector<int> LF(n + 1, 0);
+    for (int i = 0; i <= n; i++) {
+        if (i == primary) continue;
+        LF[i] = C[in[i < primary ? i : i - 1]]++;
+    }
+    // row 0 starts with the sentinel, so its last character ends the data
+    int row = 0;
+    for (int k = n - 1; k >= 0; k--) {
+        if (row == primary) return false;
+        out[k] = in[row < primary ? row : row - 1];
+        row = LF[row];
+    }
+    return true;
+}
+
+//
+// *This function move-to-front and zero-run-length codes the BWT output into
+// symbols, ending with PSEUDO_EOF.
+//
+inline void bwtMTFEncode(const unsigned char* in, int n, vector<int> &symbols) {
+    unsigned char order[256];
+    for (int i = 0; i < 256; i++) order[i] = (unsigned char)i;
+    int zeros = 0;
+    for (int i = 0; i <= n; i++) {
+        int v = 0;
+        if (i < n) {
+            unsigned char c = in[i];
+            while (order[v] != c) v++;
+            for (int j = v; j > 0; j--) order[j] = order[j - 1];
+            order[0] = c;
+        }
+        if (v == 0 && i < n) {
+            zeros++;
+            continue;
+        }
+        // a run of z zeros is written as z + 1 in bijective base 2
+        if (zeros > 0) {
+            unsigned int run = zeros + 1;
+            while (run > 1) {
+                symbols.push_back((run & 1) ? BWT_RUNB : BWT_RUNA);
+                run >>= 1;
+            }
+            zeros = 0;
+        }
+        if (i < n) symbols.push_back(bwtSymbol(v));
+    }
+    symbols.push_back(PSEUDO_EOF);
+}
+
+//
+// *This function Huffman decodes one block's symbols and undoes the
+// zero-run-length and move-to-front coding into out.  Returns false if the
+// symbols do not make exactly n bytes.
+//
+inline bool bwtMTFDecode(ibitbuffer &bits, HuffmanNode* tree, int n,
+                         unsigned char* out) {
+    unsigned char order[256];
+    for (int i = 0; i < 256; i++) order[i] = (unsigned char)i;
+    int op = 0;
+    unsigned int run = 0, weight = 1;
+    while (true) {
+        int symbol = readSymbol(bits, tree);
+        if (symbol == BWT_RUNA || symbol == BWT_RUNB) {
+            run += (symbol == BWT_RUNA ? 1 : 2) * weight;
+            weight <<= 1;
+            if (run > (unsigned int)n) return false;
+            continue;
+        }
+        if (run > 0) {
+            if (run > (unsigned int)(n - op)) return false;
+            for (unsigned int i = 0; i < run; i++) out[op++] = order[0];
+            run = 0;
+            weight = 1;
+        }
+        if (symbol == PSEUDO_EOF || bits.overrun()) break;
+        int v = bwtValue(symbol);
+        if (v < 1 || v > 255 || op >= n) return false;
+        unsigned char c = order[v];
+        for (int j = v; j > 0; j--) order[j] = order[j - 1];
+        order[0] = c;
+        out[op++] = c;
+    }
+    return op == n && !bits.overrun();
+}
+
+//
+// *This function compresses one block into its record in out.
+//
+inline void bwtCompressBlock(const unsigned char* data, int n, string &out) {
+    vector<unsigned char> transformed(n);
+    int primary = bwtForward(data, n, transformed.data());
+    vector<int> symbols;
+    bwtMTFEncode(transformed.data(), n, symbols);
+
+    vector<int> counts(BWT_SYMBOLS, 0);
+    for (unsigned int i = 0; i < symbols.size(); i++) counts[symbols[i]]++;
+    hashmapF frequencyMap;
+    buildFrequencyMap(counts, frequencyMap);
+    HuffmanNode* tree = buildCodingTree(frequencyMap);
+    vector<HuffmanCode> codes = buildCodeTable(tree, BWT_SYMBOLS);
+    obitbuffer bits;
+    for (unsigned int i = 0; i < symbols.size(); i++) {
+        writeSymbol(bits, codes, symbols[i]);
+    }
+    freeTree(tree);
+
+    vector<unsigned char> &payload = bits.bytes();
+    ostringstream record;
+    record << n << ' ' << primary << frequencyMap << payload.size() << '\n';
+    writeBytes(record, payload.data(), payload.size());
+    out = record.str();
+}
+
+//
+// A block record read from a file, waiting to be decoded.
+//
+struct bwtblock {
+    int rawSize;
+    int primary;
+    hashmapF frequencyMap;
+    vector<unsigned char> payload;
+};
+
+//
+// *This function reads the next block record from input, a file whose
+// blocks hold at most blockSize bytes.  Returns false at the end of the file
+// or if the record is malformed; sizes are checked before anything is
+// allocated for them, and table keys against the MTF/RLE alphabet.
+//
+inline bool readBWTBlock(istream &input, bwtblock &block, int blockSize) {
+    size_t payloadSize = 0;
+    if (!(input >> block.rawSize >> block.primary) || block.rawSize < 1 ||
+        block.rawSize > blockSize || block.primary < 0 ||
+        block.primary > block.rawSize) {
+        return false;
+    }
+    if (!readFrequencyMap(input, block.frequencyMap, BWT_SYMBOLS) ||
+        !(input >> payloadSize) || input.get() != '\n' ||
+        payloadSize > bytesLeft(input)) {
+        return false;
+    }
+    block.payload.resize(payloadSize);
+    if (payloadSize > 0) input.read((char*)&block.payload[0], payloadSize);
+    return (bool)input;
+}
+
+//
+// *This function decodes one block record into out.  Returns false if it is
+// corrupt.
+//
+inline bool bwtDecompressBlock(bwtblock &block, vector<unsigned char> &out) {
+    HuffmanNode* tree = buildCodingTree(block.frequencyMap);
+    if (tree == nullptr) return false;
+    vector<unsigned char> transformed(block.rawSize);
+    out.resize(block.rawSize);
+    ibitbuffer bits(block.payload.data(), block.payload.size());
+    bool ok = bwtMTFDecode(bits, tree, block.rawSize, transformed.data()) &&
+              bwtInverse(transformed.data(), block.rawSize, block.primary,
+                         out.data());
+    freeTree(tree);
+    return ok;
+}
+
+//
+// *This function fits bwtCompress into budget bytes, 0 for no limit.  Each
+// block in flight holds about BWT_BLOCK_COST times blockSize (suffix array,
+// MTF symbols, payload), so it lowers workers first, down to one, and then
+// blockSize, not below BWT_MIN_BLOCK_SIZE.  blockSize 0 means
+// BWT_DEFAULT_BLOCK_SIZE and workers 0 means workerCount().
+//
+inline void fitBWTBudget(size_t budget, int &blockSize, int &workers) {
+    if (blockSize < 1) blockSize = BWT_DEFAULT_BLOCK_SIZE;
+    if (workers < 1) workers = workerCount();
+    if (budget == 0) return;
+    while (workers > 1 &&
+           (size_t)workers * BWT_BLOCK_COST * blockSize > budget) {
+        workers--;
+    }
+    if ((size_t)blockSize > budget / BWT_BLOCK_COST) {
+        blockSize = max((int)(budget / BWT_BLOCK_COST), BWT_MIN_BLOCK_SIZE);
+    }
+}
+
+//
+// *This function compresses filename into (filename + ".huf") in block-sorting
+// mode, compressing up to workers blocks (workerCount() if 0) at a time in
+// parallel.  Returns the compressed size in bytes, or -1 on error.
+//
+inline long bwtCompress(string filename, int blockSize, int workers = 0) {
+    ifstream input(filename, ios::binary);
+    if (!input.is_open()) {
+        cout << "File does not exist." << endl;
+        return -1;
+    }
+    if (blockSize < 1) blockSize = BWT_DEFAULT_BLOCK_SIZE;
+    blockSize = min(blockSize, BWT_MAX_BLOCK_SIZE);
+    ofstream output(filename + ".huf", ios::binary);
+    output << HEADER_TAG << BWT_MODE << blockSize << '\n';
+
+    int batch = workers > 0 ? workers : workerCount();
+    vector<vector<unsigned char> > blocks(batch);
+    vector<string> records(batch);
+    while (input) {
+        int count = 0;
+        for (; count < batch && input; count++) {
+            blocks[count].resize(blockSize);
+            input.read((char*)blocks[count].data(), blockSize);
+            blocks[count].resize((size_t)input.gcount());
+            if (blocks[count].empty()) break;
+        }
+        parallelFor(count, [&](int i) {
+            bwtCompressBlock(blocks[i].data(), (int)blocks[i].size(),
+                             records[i]);
+        });
+        for (int i = 0; i < count; i++) {
+            if (!blocks[i].empty()) output << records[i];
+        }
+    }
+    long size = (long)output.tellp();
+    output.close();
+    return size;
+}
+
+//
+// *This function decompresses a file written by bwtCompress, decoding up to
+// workerCount() blocks at a time in parallel.  The output is named the same
+// way decompress names it.  Returns false if the file is corrupt.
+//
+inline bool bwtDecompress(string filename) {
+    ifstream input(filename.substr(0, filename.find(".huf")) + ".huf",
+                   ios::binary);
+    int blockSize = 0;
+    if (input.get() != HEADER_TAG || input.get() != BWT_MODE ||
+        !(input >> blockSize) || blockSize < 1 ||
+        blockSize > BWT_MAX_BLOCK_SIZE || input.get() != '\n') {
+        cout << "Not a block-sorting file." << endl;
+        return false;
+    }
+    ofstream output(uncompressedFilename(filename), ios::binary);
+
+    int batch = workerCount();
+    vector<bwtblock> blocks(batch);
+    vector<vector<unsigned char> > outs(batch);
+    vector<char> ok(batch);
+    while (input.peek() != EOF) {
+        int count = 0;
+        while (count < batch && input.peek() != EOF) {
+            blocks[count].frequencyMap = hashmapF();
+            if (!readBWTBlock(input, blocks[count], blockSize)) {
+                cout << "Corrupt block-sorting data." << endl;
+                return false;
+            }
+            count++;
+        }
+        parallelFor(count, [&](int i) {
+            ok[i] = bwtDecompressBlock(blocks[i], outs[i]);
+        });
+        for (int i = 0; i < count; i++) {
+            if (!ok[i]) {
+                cout << "Corrupt block-sorting data." << endl;
+                return false;
+            }
+            writeBytes(output, outs[i].data(), outs[i].size());
+        }
+    }
+    output.close();
+    return true;
+}
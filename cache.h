@@ -0,0 +1,219 @@
+//
+// cache.h
+//
+// A result cache for batch jobs that compress the same files again and
+// again.  The cache is a directory holding:
+//      - objects, "<hash>-<size>.huf": a compressed output, named by a
+//        128-bit hash of the input's bytes and of the options it was
+//        compressed with, and by the input's size, so two inputs share an
+//        object only if both their hashes and their sizes match;
+//      - an index, one line per input compressed through it, recording the
+//        input's size and modification time, its object, and the size and
+//        modification time of the output written for it.
+// An input whose size and time match its index line, and whose output is
+// still as it was written, is skipped without being read.  Otherwise it is
+// read and hashed; if an object with that name exists it is copied to the
+// output, and only if not is the input compressed (and the output stored as
+// a new object).
+//
+// Index format, one line per input:
+//      <size> <mtime> <object> <output size> <output mtime> <key length>:<key>
+// where times are in nanoseconds and the key is "<options>\t<filename>".
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <cstdio>
+#include <iomanip>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "checksum.h"
+#include "util.h"
+
+using namespace std;
+
+const string CACHE_INDEX = "index";
+
+struct cacheentry {
+    size_t size;
+    long long mtime;
+    string object;  // "<hash>-<size>", the object's name without ".huf"
+    size_t outputSize;
+    long long outputMtime;
+};
+
+struct huffcache {
+    string directory;
+    map<string, cacheentry> entries;
+    int unchanged;  // skipped on size and time
+    int hits;       // output copied from an object
+    int misses;     // compressed
+    double seconds;
+};
+
+//
+// *This function gets the size and modification time (in nanoseconds) of
+// filename.  Returns false if it does not exist.
+//
+inline bool fileStamp(string filename, size_t &size, long long &mtime) {
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) return false;
+    size = (size_t)info.st_size;
+    mtime = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+    return true;
+}
+
+//
+// *This function returns the hex form of a hash.
+//
+inline string hashName(uint64_t hash) {
+    ostringstream ss;
+    ss << hex << setw(16) << setfill('0') << hash;
+    return ss.str();
+}
+
+//
+// *This function returns the name of the object for n bytes of data
+// compressed with options: a 128-bit hash of both, as dedup.h names chunks,
+// and n.
+//
+inline string objectName(const unsigned char* data, size_t n, string options) {
+    uint64_t seed = contentHash((const unsigned char*)options.data(),
+                                options.length());
+    ostringstream ss;
+    ss << hashName(contentHash(data, n, seed))
+       << hashName(contentHash(data, n, seed ^ HASH_PRIME1)) << '-' << n;
+    return ss.str();
+}
+
+//
+// *This function copies the file from to the file to, by way of a temporary
+// file renamed over it.  Returns false if either cannot be opened.
+//
+inline bool copyFile(string from, string to) {
+    ifstream input(from, ios::binary);
+    if (!input.is_open()) return false;
+    string tempname = to + ".tmp";
+    ofstream output(tempname, ios::binary);
+    if (!output.is_open()) return false;
+    output << input.rdbuf();
+    output.close();
+    if (!output || rename(tempname.c_str(), to.c_str()) != 0) {
+        remove(tempname.c_str());
+        return false;
+    }
+    return true;
+}
+
+//
+// *This function opens the cache in directory, creating it if needed, and
+// reads its index.  Returns false if the directory cannot be created.
+//
+inline bool loadCache(string directory, huffcache &cache) {
+    cache.directory = directory;
+    cache.entries.clear();
+    cache.unchanged = cache.hits = cache.misses = 0;
+    cache.seconds = 0;
+    mkdir(directory.c_str(), 0755);
+    struct stat info;
+    if (stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+        cout << "Cannot use cache directory: " << directory << endl;
+        return false;
+    }
+    ifstream input(directory + "/" + CACHE_INDEX);
+    cacheentry entry;
+    size_t length;
+    while (input >> entry.size >> entry.mtime >> entry.object
+                 >> entry.outputSize >> entry.outputMtime >> length) {
+        input.get();  // ':'
+        string key(length, 0);
+        if (length > 0) input.read(&key[0], length);
+        cache.entries[key] = entry;
+    }
+    return true;
+}
+
+//
+// *This function writes the cache's index back to its directory.
+//
+inline void saveCache(huffcache &cache) {
+    string indexname = cache.directory + "/" + CACHE_INDEX;
+    ofstream output(indexname + ".tmp");
+    for (auto &e : cache.entries) {
+        const cacheentry &entry = e.second;
+        output << entry.size << ' ' << entry.mtime << ' ' << entry.object
+               << ' ' << entry.outputSize << ' ' << entry.outputMtime << ' '
+               << e.first.length() << ':' << e.first << '\n';
+    }
+    output.close();
+    rename((indexname + ".tmp").c_str(), indexname.c_str());
+}
+
+//
+// *This function brings filename + ".huf" up to date through the cache.
+// options names the way compressor compresses (two different ways must have
+// different options), and compressor writes filename + ".huf" and returns
+// false on failure.  Returns false if the file cannot be read or compressor
+// fails.
+//
+inline bool cachedCompress(huffcache &cache, string filename, string options,
+                           function<bool()> compressor) {
+    auto start = chrono::steady_clock::now();
+    string key = options + "\t" + filename;
+    string outputname = filename + ".huf";
+    cacheentry entry;
+    size_t outputSize;
+    long long outputMtime;
+    if (!fileStamp(filename, entry.size, entry.mtime)) {
+        cout << "File does not exist: " << filename << endl;
+        return false;
+    }
+    auto found = cache.entries.find(key);
+    if (found != cache.entries.end() &&
+        found->second.size == entry.size &&
+        found->second.mtime == entry.mtime &&
+        fileStamp(outputname, outputSize, outputMtime) &&
+        found->second.outputSize == outputSize &&
+        found->second.outputMtime == outputMtime) {
+        cache.unchanged++;
+        cache.seconds += chrono::duration<double>(
+            chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    vector<unsigned char> data;
+    if (!readFileBytes(filename, data)) return false;
+    entry.object = objectName(data.data(), data.size(), options);
+    string objectname = cache.directory + "/" + entry.object + ".huf";
+    if (copyFile(objectname, outputname)) {
+        cache.hits++;
+    } else {
+        if (!compressor()) return false;
+        copyFile(outputname, objectname);
+        cache.misses++;
+    }
+    if (fileStamp(outputname, entry.outputSize, entry.outputMtime)) {
+        cache.entries[key] = entry;
+    }
+    cache.seconds += chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+//
+// *This function prints the cache hit and miss counts for this run.
+//
+inline void printCacheStats(const huffcache &cache) {
+    int total = cache.unchanged + cache.hits + cache.misses;
+    cout << "Cache: " << cache.unchanged << " unchanged, " << cache.hits
+         << " hits, " << cache.misses << " misses (" << total - cache.misses
+         << " of " << total << " not compressed) in " << cache.seconds
+         << " s" << endl;
+}
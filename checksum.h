@@ -0,0 +1,140 @@
+//
+// checksum.h
+//
+// CRC32C (the Castagnoli polynomial) for block integrity checks.  On x86-64
+// processors with SSE4.2 the crc32 instruction does the work 8 bytes at a
+// time; everywhere else a slicing-by-8 table version is used.  The choice is
+// made once, at run time, so one build runs on both.
+//
+// contentHash is a 64-bit hash for naming cached results by their content,
+// where 32 bits would collide too soon.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define HUFF_HAVE_CRC32_INSTRUCTION 1
+#endif
+
+const uint32_t CRC32C_POLY = 0x82F63B78;  // reflected
+
+//
+// The slicing-by-8 tables: t[0] is the usual byte-at-a-time table and t[k]
+// advances a byte through k more zero bytes.
+//
+struct crc32ctables {
+    uint32_t t[8][256];
+
+    crc32ctables() {
+        for (int i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int j = 0; j < 8; j++) {
+                crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+            }
+            t[0][i] = crc;
+        }
+        for (int i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) {
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+//
+// *This function returns the tables, built on first use.
+//
+inline const crc32ctables &crc32cTables() {
+    static const crc32ctables tables;
+    return tables;
+}
+
+//
+// *This function updates crc with n bytes using slicing-by-8.
+//
+inline uint32_t crc32cSoftware(uint32_t crc, const unsigned char* data,
+                               size_t n) {
+    const uint32_t (*t)[256] = crc32cTables().t;
+    crc = ~crc;
+    while (n >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, data, 4);
+        memcpy(&hi, data + 4, 4);
+        lo ^= crc;  // little-endian byte order
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^
+              t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^
+              t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        data += 8;
+        n -= 8;
+    }
+    while (n-- > 0) crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    return ~crc;
+}
+
+#ifdef HUFF_HAVE_CRC32_INSTRUCTION
+//
+// *This function updates crc with n bytes using the SSE4.2 crc32
+// instruction.
+//
+__attribute__((target("sse4.2")))
+inline uint32_t crc32cHardware(uint32_t crc, const unsigned char* data,
+                               size_t n) {
+    uint64_t c = ~crc;
+    while (n >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        c = _mm_crc32_u64(c, word);
+        data += 8;
+        n -= 8;
+    }
+    uint32_t c32 = (uint32_t)c;
+    while (n-- > 0) c32 = _mm_crc32_u8(c32, *data++);
+    return ~c32;
+}
+#endif
+
+//
+// *This function updates crc (0 to start) with n bytes of data.
+//
+inline uint32_t crc32c(uint32_t crc, const unsigned char* data, size_t n) {
+#ifdef HUFF_HAVE_CRC32_INSTRUCTION
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware) return crc32cHardware(crc, data, n);
+#endif
+    return crc32cSoftware(crc, data, n);
+}
+
+const uint64_t HASH_PRIME1 = 0x9E3779B185EBCA87ULL;
+const uint64_t HASH_PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+
+//
+// *This function returns a 64-bit hash of n bytes of data.  It is not
+// cryptographic, but mixes 8 bytes per step with two multiplies, so it runs
+// at memory speed.  Different seeds give unrelated hashes.
+//
+inline uint64_t contentHash(const unsigned char* data, size_t n,
+                            uint64_t seed = 0) {
+    uint64_t h = seed ^ (n * HASH_PRIME1);
+    for (; n >= 8; data += 8, n -= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        word *= HASH_PRIME2;
+        word = (word << 31) | (word >> 33);
+        h ^= word * HASH_PRIME1;
+        h = ((h << 27) | (h >> 37)) * HASH_PRIME1 + HASH_PRIME2;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data, n);
+    h ^= tail * HASH_PRIME2;
+    h ^= h >> 33;
+    h *= HASH_PRIME2;
+    h ^= h >> 29;
+    h *= HASH_PRIME1;
+    h ^= h >> 32;
+    return h;
+}
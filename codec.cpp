@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include "codec.h"
+#include "kernels.h"
+
+using namespace std;
+
+template struct huffkernel<256, 11, 11>;
+template struct huffkernel<256, 12, 12>;
+template struct huffkernel<256, 15, 12>;
+
+#define HUFF_BYTE_KERNEL(maxLength, lookupBits) \
+    {maxLength, lookupBits, \
+     huffkernel<256, maxLength, lookupBits>::buildLookup, \
+     huffkernel<256, maxLength, lookupBits>::encode, \
+     huffkernel<256, maxLength, lookupBits>::decode}
+
+extern const bytekernel BYTE_KERNELS[] = {
+    HUFF_BYTE_KERNEL(11, 11),
+    HUFF_BYTE_KERNEL(12, 12),
+    HUFF_BYTE_KERNEL(15, 12),
+};
+const int BYTE_KERNEL_COUNT = sizeof(BYTE_KERNELS) / sizeof(BYTE_KERNELS[0]);
+
+#undef HUFF_BYTE_KERNEL
+
+//
+// *This function returns the index of the fastest byte kernel for codes of
+// at most longest bits, or -1 if none can code them.
+//
+int selectKernel(int longest) {
+    for (int k = 0; k < BYTE_KERNEL_COUNT; k++) {
+        if (longest <= BYTE_KERNELS[k].maxLength) return k;
+    }
+    return -1;
+}
+
+//
+// *This function sets ctx.lengths to Huffman code lengths for ctx.counts,
+// building the tree in the context's arrays: leaves sorted by count, then
+// internal nodes, which are made in order of weight, so the two lightest
+// nodes are always at the front of one of the two runs.  Returns the
+// longest length.
+//
+int buildCodeLengths(huffcontext &ctx) {
+    int k = 0;
+    for (int s = 0; s < CODEC_SYMBOLS; s++) {
+        ctx.lengths[s] = 0;
+        if (ctx.counts[s] > 0) ctx.order[k++] = s;
+    }
+    const uint64_t* counts = ctx.counts;
+    sort(ctx.order, ctx.order + k, [&](int a, int b) {
+        return counts[a] < counts[b] || (counts[a] == counts[b] && a < b);
+    });
+    if (k == 1) {
+        ctx.lengths[ctx.order[0]] = 1;
+        return 1;
+    }
+    for (int i = 0; i < k; i++) ctx.weights[i] = counts[ctx.order[i]];
+    int leaf = 0, internal = k;
+    for (int next = k; next < 2 * k - 1; next++) {
+        int pair[2];
+        for (int j = 0; j < 2; j++) {
+            if (leaf < k && (internal >= next ||
+                             ctx.weights[leaf] <= ctx.weights[internal])) {
+                pair[j] = leaf++;
+            } else {
+                pair[j] = internal++;
+            }
+        }
+        ctx.weights[next] = ctx.weights[pair[0]] + ctx.weights[pair[1]];
+        ctx.parent[pair[0]] = ctx.parent[pair[1]] = next;
+    }
+    int longest = 0;
+    ctx.depth[2 * k - 2] = 0;
+    for (int i = 2 * k - 3; i >= 0; i--) {  // parents come after children
+        ctx.depth[i] = ctx.depth[ctx.parent[i]] + 1;
+        if (i < k) {
+            ctx.lengths[ctx.order[i]] = (unsigned char)ctx.depth[i];
+            longest = max(longest, ctx.depth[i]);
+        }
+    }
+    return longest;
+}
+
+//
+// *This function fills codes with canonical codes for lengths, bit-reversed
+// so the first bit of a code is bit 0, the order the bit buffers use.
+//
+void buildCanonicalCodes(const unsigned char* lengths,
+                         HuffmanCode* codes) {
+    int lengthCount[CODEC_MAX_LENGTH + 1] = {0};
+    for (int s = 0; s < CODEC_SYMBOLS; s++) lengthCount[lengths[s]]++;
+    uint32_t next[CODEC_MAX_LENGTH + 1] = {0};
+    uint32_t code = 0;
+    lengthCount[0] = 0;
+    for (int l = 1; l <= CODEC_MAX_LENGTH; l++) {
+        code = (code + lengthCount[l - 1]) << 1;
+        next[l] = code;
+    }
+    for (int s = 0; s < CODEC_SYMBOLS; s++) {
+        int l = lengths[s];
+        codes[s].length = l;
+        codes[s].bits = 0;
+        if (l == 0) continue;
+        uint32_t c = next[l]++;
+        for (int b = 0; b < l; b++) {
+            codes[s].bits |= (uint64_t)((c >> (l - 1 - b)) & 1) << b;
+        }
+    }
+}
+
+//
+// *This function sets ctx.lengths to the codes compress uses for n bytes
+// with byte counts counts (which may be ctx.counts) and returns the size it
+// writes for them, CODEC_HEADER_SIZE + n if they are stored.  It needs only
+// the counts, so it sizes an input without coding it.
+//
+size_t codecSize(const uint64_t* counts, size_t n, huffcontext &ctx) {
+    uint64_t original[CODEC_SYMBOLS];
+    memcpy(original, counts, sizeof(original));
+    memcpy(ctx.counts, original, sizeof(original));
+    size_t bits = 0;
+    if (n > 0) {
+        // halve the counts until no code is too long; rare symbols keep a
+        // count of one
+        while (buildCodeLengths(ctx) > CODEC_MAX_LENGTH) {
+            for (int s = 0; s < CODEC_SYMBOLS; s++) {
+                if (ctx.counts[s] > 0) ctx.counts[s] = (ctx.counts[s] + 1) / 2;
+            }
+        }
+        for (int s = 0; s < CODEC_SYMBOLS; s++) {
+            bits += original[s] * ctx.lengths[s];
+        }
+    }
+    size_t huffmanSize = CODEC_HEADER_SIZE + CODEC_TABLE_SIZE + (bits + 7) / 8;
+    if (n == 0 || huffmanSize >= CODEC_HEADER_SIZE + n) {
+        return CODEC_HEADER_SIZE + n;
+    }
+    return huffmanSize;
+}
+
+//
+// *This function compresses n bytes of in into out, which has room for cap
+// bytes.  Returns the compressed size, or CODEC_ERROR if out is too small
+// or n does not fit in 32 bits.
+//
+size_t compress(const uint8_t* in, size_t n, uint8_t* out, size_t cap,
+                huffcontext &ctx) {
+    if (n > 0xFFFFFFFFULL || cap < CODEC_HEADER_SIZE) return CODEC_ERROR;
+    for (int i = 1; i <= 4; i++) out[i] = (uint8_t)(n >> (8 * (i - 1)));
+
+    memset(ctx.tally, 0, sizeof(ctx.tally));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        ctx.tally[0][in[i]]++;
+        ctx.tally[1][in[i + 1]]++;
+        ctx.tally[2][in[i + 2]]++;
+        ctx.tally[3][in[i + 3]]++;
+    }
+    for (; i < n; i++) ctx.tally[0][in[i]]++;
+    for (int s = 0; s < CODEC_SYMBOLS; s++) {
+        ctx.counts[s] = (uint64_t)ctx.tally[0][s] + ctx.tally[1][s] +
+                        ctx.tally[2][s] + ctx.tally[3][s];
+    }
+
+    size_t huffmanSize = codecSize(ctx.counts, n, ctx);
+    if (huffmanSize == CODEC_HEADER_SIZE + n) {
+        if (cap < CODEC_HEADER_SIZE + n) return CODEC_ERROR;
+        out[0] = CODEC_STORED;
+        if (n > 0) memcpy(out + CODEC_HEADER_SIZE, in, n);
+        return CODEC_HEADER_SIZE + n;
+    }
+    if (cap < huffmanSize) return CODEC_ERROR;
+
+    out[0] = CODEC_HUFFMAN;
+    uint8_t* table = out + CODEC_HEADER_SIZE;
+    for (int s = 0; s < CODEC_SYMBOLS; s += 2) {
+        table[s / 2] = (uint8_t)(ctx.lengths[s] | (ctx.lengths[s + 1] << 4));
+    }
+    int longest = 0;
+    for (int s = 0; s < CODEC_SYMBOLS; s++) {
+        longest = max(longest, (int)ctx.lengths[s]);
+    }
+    buildCanonicalCodes(ctx.lengths, ctx.codes);
+    uint8_t* dst = table + CODEC_TABLE_SIZE;
+    BYTE_KERNELS[selectKernel(longest)].encode(in, n, ctx.codes, dst,
+                                               out + huffmanSize);
+    return huffmanSize;
+}
+
+//
+// *This function builds the decode tree (in the arena, then flattened into
+// nodes) and lookup table for a packed table of code lengths.  Returns false
+// if the lengths are not a complete code.
+//
+bool buildDecodeTables(const uint8_t* table, huffcontext &ctx) {
+    if (ctx.decodeReady &&
+        memcmp(table, ctx.decodeTable, CODEC_TABLE_SIZE) == 0) {
+        return true;
+    }
+    ctx.decodeReady = false;
+    unsigned char lengths[CODEC_SYMBOLS];
+    uint32_t kraft = 0;  // in units of 2^-CODEC_MAX_LENGTH
+    int symbols = 0;
+    int longest = 0;
+    for (int s = 0; s < CODEC_SYMBOLS; s++) {
+        lengths[s] = (table[s / 2] >> (4 * (s & 1))) & 0x0F;
+        longest = max(longest, (int)lengths[s]);
+        if (lengths[s] == 0) continue;
+        kraft += 1u << (CODEC_MAX_LENGTH - lengths[s]);
+        symbols++;
+    }
+    bool single = symbols == 1 && kraft == 1u << (CODEC_MAX_LENGTH - 1);
+    if (kraft != 1u << CODEC_MAX_LENGTH && !single) return false;
+    buildCanonicalCodes(lengths, ctx.codes);
+
+    HuffmanNode* root = &ctx.arena[0];
+    int used = 1;
+    root->character = NOT_A_CHAR;
+    root->zero = root->one = nullptr;
+    for (int s = 0; s < CODEC_SYMBOLS; s++) {
+        HuffmanNode* node = root;
+        for (int b = 0; b < ctx.codes[s].length; b++) {
+            HuffmanNode* &child = ((ctx.codes[s].bits >> b) & 1) ?
+                                  node->one : node->zero;
+            if (child == nullptr) {
+                child = &ctx.arena[used++];
+                child->character = NOT_A_CHAR;
+                child->zero = child->one = nullptr;
+            }
+            node = child;
+        }
+        if (ctx.codes[s].length > 0) node->character = s;
+    }
+
+    if (flattenNodes(ctx.arena, ctx.nodes, ctx.queue, CODEC_SYMBOLS) < 0) {
+        return false;
+    }
+    ctx.decodeKernel = selectKernel(longest);
+    BYTE_KERNELS[ctx.decodeKernel].buildLookup(ctx.nodes, ctx.lookup);
+    memcpy(ctx.decodeTable, table, CODEC_TABLE_SIZE);
+    ctx.decodeReady = true;
+    return true;
+}
+
+//
+// *This function decompresses n bytes of in, written by compress, into out,
+// which has room for cap bytes.  Returns the decompressed size, or
+// CODEC_ERROR if in is corrupt or out is too small.
+//
+size_t decompress(const uint8_t* in, size_t n, uint8_t* out, size_t cap,
+                  huffcontext &ctx) {
+    size_t rawSize = decompressedSize(in, n);
+    if (rawSize == CODEC_ERROR || rawSize > cap) return CODEC_ERROR;
+    if (in[0] == CODEC_STORED) {
+        if (n != CODEC_HEADER_SIZE + rawSize) return CODEC_ERROR;
+        if (rawSize > 0) memcpy(out, in + CODEC_HEADER_SIZE, rawSize);
+        return rawSize;
+    }
+    if (in[0] != CODEC_HUFFMAN || n < CODEC_HEADER_SIZE + CODEC_TABLE_SIZE ||
+        !buildDecodeTables(in + CODEC_HEADER_SIZE, ctx)) {
+        return CODEC_ERROR;
+    }
+    size_t start = CODEC_HEADER_SIZE + CODEC_TABLE_SIZE;
+    if (!BYTE_KERNELS[ctx.decodeKernel].decode(in + start, n - start,
+                                               ctx.lookup, ctx.nodes, out,
+                                               rawSize)) {
+        return CODEC_ERROR;
+    }
+    return rawSize;
+}
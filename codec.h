@@ -0,0 +1,99 @@
+//
+// codec.h
+//
+// A buffer-to-buffer Huffman codec for embedding in other programs: no
+// files, no streams, and no allocation.  Everything a call needs (byte
+// counts, the node arena the tree is built in, the code table and the
+// decode lookup table) lives in a huffcontext the caller keeps between
+// calls, so once a context exists, compress and decompress allocate
+// nothing.  A context must not be used by two threads at once.
+//
+// Codes are canonical and at most CODEC_MAX_LENGTH bits, so the table is
+// sent as one 4-bit length per byte value.  The loops that write and read
+// the codes are the kernels in kernels.h, picked by the longest code: when
+// it is short enough every code is found with one table lookup, otherwise
+// the few longer codes continue from the node the lookup ends on, in the
+// tree flattened (flattree.h) into the context.  The decode tables are
+// rebuilt only when the code lengths differ from the previous call's.
+//
+// Buffer layout:
+//      <kind> <raw size, 4 bytes little-endian>
+//      kind CODEC_HUFFMAN: <128 bytes of code lengths> <bitstream>
+//      kind CODEC_STORED:  <raw bytes>
+// compressBound(n) bytes of output are always enough.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+#include "huffcode.h"
+#include "kernels.h"
+#include "flattree.h"
+#include "memory.h"
+#include "util.h"
+
+using namespace std;
+
+const unsigned char CODEC_HUFFMAN = 'H';
+const unsigned char CODEC_STORED = 'S';
+const int CODEC_SYMBOLS = 256;
+const int CODEC_MAX_LENGTH = 15;
+const size_t CODEC_HEADER_SIZE = 5;
+const size_t CODEC_TABLE_SIZE = CODEC_SYMBOLS / 2;
+const size_t CODEC_ERROR = (size_t)-1;
+
+struct huffcontext {
+    huffcontext() : decodeReady(false) {}
+
+    // encoding
+    uint32_t tally[4][CODEC_SYMBOLS];  // four tables for independent stores
+    uint64_t counts[CODEC_SYMBOLS];
+    int order[CODEC_SYMBOLS];          // symbols present, rarest first
+    uint64_t weights[2 * CODEC_SYMBOLS];
+    int parent[2 * CODEC_SYMBOLS];
+    int depth[2 * CODEC_SYMBOLS];
+    unsigned char lengths[CODEC_SYMBOLS];
+    HuffmanCode codes[CODEC_SYMBOLS];
+
+    // decoding
+    bool decodeReady;
+    unsigned char decodeTable[CODEC_TABLE_SIZE];  // lengths the tables are for
+    int decodeKernel;                             // index in BYTE_KERNELS
+    HuffmanNode arena[2 * CODEC_SYMBOLS];
+    HuffmanNode* queue[CODEC_SYMBOLS];             // for flattenNodes
+    flatnode nodes[CODEC_SYMBOLS];
+    codecentry lookup[1 << KERNEL_MAX_LOOKUP_BITS];
+
+    static void* operator new(size_t size) {
+        return trackedAllocate(MEMORY_CODEC, size);
+    }
+    static void operator delete(void* p, size_t size) {
+        trackedFree(MEMORY_CODEC, p, size);
+    }
+};
+
+//
+// *This function returns the most bytes compress can write for n bytes.
+//
+inline size_t compressBound(size_t n) {
+    return n + CODEC_HEADER_SIZE;
+}
+
+//
+// *This function returns the raw size recorded in a compressed buffer, or
+// CODEC_ERROR if it is too short to hold one.
+//
+inline size_t decompressedSize(const uint8_t* in, size_t n) {
+    if (n < CODEC_HEADER_SIZE) return CODEC_ERROR;
+    return in[1] | (in[2] << 8) | (in[3] << 16) | ((size_t)in[4] << 24);
+}
+
+int buildCodeLengths(huffcontext &ctx);
+void buildCanonicalCodes(const unsigned char* lengths, HuffmanCode* codes);
+size_t codecSize(const uint64_t* counts, size_t n, huffcontext &ctx);
+size_t compress(const uint8_t* in, size_t n, uint8_t* out, size_t cap,
+                huffcontext &ctx);
+bool buildDecodeTables(const uint8_t* table, huffcontext &ctx);
+size_t decompress(const uint8_t* in, size_t n, uint8_t* out, size_t cap,
+                  huffcontext &ctx);
@@ -0,0 +1,716 @@
+//
+// daemon.h
+//
+// A long-running compression service on a Unix domain socket, for callers
+// that compress many small payloads and cannot afford to start a process or
+// rebuild tables for each one.  Dictionaries are loaded and their code
+// tables and trees built once at startup, before any worker runs, so the
+// workers only read them.  The listening thread polls the idle connections
+// and hands a connection to the fixed pool of worker threads only when a
+// request has arrived on it; the worker serves that one request and gives
+// the connection back, so an idle client never holds a worker.  A request
+// that stalls for DAEMON_RECEIVE_TIMEOUT seconds closes its connection, so
+// a stalled one does not hold a worker either.  Each worker keeps its
+// buffers (daemoncontext) from one request to the next.
+//
+// Every message, in both directions, is a 4-byte little-endian length
+// followed by that many bytes:
+//      request   <op> <dictionary id, 4 bytes, -1 for none> <payload>
+//      response  <status> <payload>
+// where op is DAEMON_COMPRESS, DAEMON_DECOMPRESS or DAEMON_STATS and status
+// is DAEMON_OK or DAEMON_ERROR (with a message as the payload).  A
+// compressed payload is "<raw size> <dictionary id>\n" followed by block
+// records (block.h); a payload small enough to fit one block is coded with
+// the dictionary's table (BACKEND_SHARED) when that is smaller, the way an
+// archive codes small members.
+//
+// The server keeps per-request latencies, which DAEMON_STATS reports.
+// huffclient is the client library, and runLoadGenerator drives a server
+// from several threads for local testing.
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "hashmap.h"
+#include "huffcode.h"
+#include "flattree.h"
+#include "block.h"
+#include "archive.h"
+#include "dictionary.h"
+#include "pipeline.h"
+#include "util.h"
+
+using namespace std;
+
+const char DAEMON_COMPRESS = 'C';
+const char DAEMON_DECOMPRESS = 'D';
+const char DAEMON_STATS = 'S';
+const char DAEMON_OK = 'K';
+const char DAEMON_ERROR = 'E';
+const uint32_t DAEMON_MAX_MESSAGE = 256 * 1024 * 1024;
+const size_t DAEMON_BUFFER_SIZE = 1024 * 1024;
+const size_t DAEMON_LATENCY_SAMPLES = 64 * 1024;
+const int DAEMON_MIN_WORKERS = 4;
+const int DAEMON_RECEIVE_TIMEOUT = 5;  // seconds a request may stall
+
+//
+// *This function reads exactly n bytes from fd.  Returns false if the
+// connection closes first or a receive times out.
+//
+inline bool readFull(int fd, void* buffer, size_t n) {
+    unsigned char* p = (unsigned char*)buffer;
+    while (n > 0) {
+        ssize_t got = recv(fd, p, n, 0);
+        if (got <= 0) return false;
+        p += got;
+        n -= (size_t)got;
+    }
+    return true;
+}
+
+//
+// *This function writes exactly n bytes to fd.  Returns false if the
+// connection is gone.
+//
+inline bool writeFull(int fd, const void* buffer, size_t n) {
+    const unsigned char* p = (const unsigned char*)buffer;
+    while (n > 0) {
+        ssize_t sent = send(fd, p, n, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        p += sent;
+        n -= (size_t)sent;
+    }
+    return true;
+}
+
+//
+// *This function removes the socket left at socketPath by an earlier
+// server.  Returns false if something other than a socket is there, which
+// is left alone.
+//
+inline bool removeSocket(string socketPath) {
+    struct stat info;
+    if (lstat(socketPath.c_str(), &info) != 0) return errno == ENOENT;
+    if (!S_ISSOCK(info.st_mode)) return false;
+    unlink(socketPath.c_str());
+    return true;
+}
+
+//
+// *This function reads one length-prefixed message from fd into message.
+// Returns false at the end of the connection or if the message is too long.
+//
+inline bool readMessage(int fd, vector<unsigned char> &message) {
+    unsigned char prefix[4];
+    if (!readFull(fd, prefix, 4)) return false;
+    uint32_t length = prefix[0] | (prefix[1] << 8) | (prefix[2] << 16) |
+                      ((uint32_t)prefix[3] << 24);
+    if (length > DAEMON_MAX_MESSAGE) return false;
+    message.resize(length);
+    return length == 0 || readFull(fd, message.data(), length);
+}
+
+//
+// *This function writes message to fd with its length prefix.  The first 4
+// bytes of message are reserved for the prefix and are filled in here, so
+// the whole message goes out in one write.
+//
+inline bool writeMessage(int fd, vector<unsigned char> &message) {
+    uint32_t length = (uint32_t)(message.size() - 4);
+    for (int i = 0; i < 4; i++) message[i] = (unsigned char)(length >> (8 * i));
+    return writeFull(fd, message.data(), message.size());
+}
+
+//
+// A dictionary ready for the daemon: its table over the bytes 0-255 and the
+// codes and flattened tree built from it.
+//
+struct daemondictionary {
+    int id;
+    hashmapF table;
+    vector<HuffmanCode> codes;
+    flattree tree;
+};
+
+//
+// *This function loads a dictionary written by trainDictionary for the
+// daemon.  The dictionary's keys are char values, as buildFrequencyMap
+// stores them; here they become bytes.  Returns false if it cannot be read.
+//
+inline bool loadDaemonDictionary(string dictname, daemondictionary &dict) {
+    huffdict source;
+    if (!loadDictionary(dictname, source)) return false;
+    vector<int> counts(ANS_SYMBOLS, 0);
+    vector<int> keys = source.frequencyMap.keys();
+    for (unsigned int i = 0; i < keys.size(); i++) {
+        if (keys[i] == PSEUDO_EOF) continue;
+        counts[(unsigned char)keys[i]] += source.frequencyMap.get(keys[i]);
+    }
+    freeDictionary(source);
+    dict.id = source.id;
+    dict.table = hashmapF();
+    buildFrequencyMap(counts, dict.table);
+    HuffmanNode* tree = buildCodingTree(dict.table);
+    dict.codes = buildCodeTable(tree, ANS_SYMBOLS);
+    flattenTree(tree, dict.tree);
+    freeTree(tree);
+    return true;
+}
+
+//
+// A stream buffer that appends what is written to a byte vector, so block
+// records go straight into a response.
+//
+class appendbuf : public streambuf {
+public:
+    appendbuf(vector<unsigned char> &out) : out(out) {}
+
+protected:
+    int overflow(int c) {
+        if (c != EOF) out.push_back((unsigned char)c);
+        return c;
+    }
+
+    streamsize xsputn(const char* s, streamsize n) {
+        out.insert(out.end(), s, s + n);
+        return n;
+    }
+
+private:
+    vector<unsigned char> &out;
+};
+
+//
+// A read-only stream buffer over bytes held elsewhere, so a request is
+// parsed where it lies.  It seeks, as readBlock's length checks need.
+//
+class memorybuf : public streambuf {
+public:
+    memorybuf(const unsigned char* data, size_t n) {
+        char* p = (char*)data;
+        setg(p, p, p + n);
+    }
+
+protected:
+    pos_type seekoff(off_type off, ios_base::seekdir dir,
+                     ios_base::openmode which = ios_base::in) {
+        off_type base = dir == ios_base::beg ? 0 :
+                        dir == ios_base::cur ? gptr() - eback() :
+                        egptr() - eback();
+        off_type to = base + off;
+        if (to < 0 || to > egptr() - eback()) return pos_type(off_type(-1));
+        setg(eback(), eback() + to, egptr());
+        return pos_type(to);
+    }
+
+    pos_type seekpos(pos_type pos,
+                     ios_base::openmode which = ios_base::in) {
+        return seekoff(off_type(pos), ios_base::beg, which);
+    }
+};
+
+//
+// A worker's buffers, kept from one request to the next so that serving a
+// request allocates nothing once they have grown.
+//
+struct daemoncontext {
+    vector<unsigned char> request;
+    vector<unsigned char> response;
+    vector<unsigned char> out;  // one decoded block
+    huffblock block;
+};
+
+//
+// *This function compresses n bytes into a daemon payload, appended to out.
+// dict may be nullptr.
+//
+inline void compressPayload(const unsigned char* data, size_t n,
+                            const daemondictionary* dict, daemoncontext &ctx,
+                            vector<unsigned char> &out) {
+    appendbuf buffer(out);
+    ostream output(&buffer);
+    output << n << ' ' << (dict != nullptr ? dict->id : -1) << '\n';
+    static const vector<HuffmanCode> none;
+    encodeMember(data, n, dict != nullptr ? dict->codes : none, ctx.block,
+                 output);
+}
+
+//
+// *This function decompresses a daemon payload, appended to out.  dicts
+// holds the loaded dictionaries by id.  Returns false if the payload is
+// corrupt or names a dictionary that is not loaded.
+//
+inline bool decompressPayload(const unsigned char* data, size_t n,
+                              const map<int, daemondictionary> &dicts,
+                              daemoncontext &ctx, vector<unsigned char> &out) {
+    memorybuf buffer(data, n);
+    istream input(&buffer);
+    size_t rawSize = 0;
+    int id = -1;
+    if (!(input >> rawSize >> id) || input.get() != '\n' ||
+        rawSize > DAEMON_MAX_MESSAGE) {
+        return false;
+    }
+    const flattree* shared = nullptr;
+    if (id >= 0) {
+        auto found = dicts.find(id);
+        if (found == dicts.end()) return false;
+        shared = &found->second.tree;
+    }
+    return decodeRecords(input, rawSize, shared, ctx.block, ctx.out, out);
+}
+
+//
+// Request latencies and byte counts for one kind of request.  The latest
+// DAEMON_LATENCY_SAMPLES latencies are kept for the percentiles.
+//
+struct latencyseries {
+    size_t requests;
+    size_t errors;
+    size_t bytesIn;
+    size_t bytesOut;
+    double totalMicros;
+    vector<double> samples;
+};
+
+//
+// Per-operation request statistics, shared by the workers.
+//
+class latencystats {
+public:
+    //
+    // *This function records one request.
+    //
+    void record(char op, double micros, size_t bytesIn, size_t bytesOut,
+                bool ok) {
+        lock_guard<mutex> lock(m);
+        latencyseries &s = series[op];
+        if (s.samples.size() < DAEMON_LATENCY_SAMPLES) {
+            s.samples.push_back(micros);
+        } else {
+            s.samples[s.requests % DAEMON_LATENCY_SAMPLES] = micros;
+        }
+        s.requests++;
+        s.errors += ok ? 0 : 1;
+        s.bytesIn += bytesIn;
+        s.bytesOut += bytesOut;
+        s.totalMicros += micros;
+    }
+
+    //
+    // *This function returns a report with one line per kind of request.
+    //
+    string report() {
+        lock_guard<mutex> lock(m);
+        ostringstream ss;
+        for (auto &e : series) {
+            latencyseries &s = e.second;
+            vector<double> sorted(s.samples);
+            sort(sorted.begin(), sorted.end());
+            ss << (e.first == DAEMON_COMPRESS ? "compress" :
+                   e.first == DAEMON_DECOMPRESS ? "decompress" : "stats")
+               << ": " << s.requests << " requests, " << s.errors
+               << " errors, " << s.bytesIn << " bytes in, " << s.bytesOut
+               << " bytes out, latency us mean "
+               << s.totalMicros / max((size_t)1, s.requests)
+               << " p50 " << percentile(sorted, 0.50)
+               << " p99 " << percentile(sorted, 0.99)
+               << " max " << percentile(sorted, 1.0) << '\n';
+        }
+        return ss.str();
+    }
+
+    //
+    // *This function returns the p-th quantile of sorted values.
+    //
+    static double percentile(const vector<double> &sorted, double p) {
+        if (sorted.empty()) return 0;
+        size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+        return sorted[min(i, sorted.size() - 1)];
+    }
+
+private:
+    mutex m;
+    map<char, latencyseries> series;
+};
+
+//
+// The server: loaded dictionaries, statistics and the worker pool.
+//
+class huffdaemon {
+public:
+    //
+    // *This function loads a dictionary.  Returns false if it cannot be read.
+    // Dictionaries must all be added before serve is called; the workers
+    // read them without a lock.
+    //
+    bool addDictionary(string dictname) {
+        daemondictionary dict;
+        if (!loadDaemonDictionary(dictname, dict)) return false;
+        dicts[dict.id] = dict;
+        return true;
+    }
+
+    //
+    // *This function listens on socketPath and serves connections until the
+    // listening socket fails.  This thread polls the listener and the idle
+    // connections; a connection with a request waiting goes to a worker,
+    // which serves one request and hands it back through returned, waking
+    // the poll through a pipe.  Returns false if it cannot listen.
+    //
+    bool serve(string socketPath) {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socketPath.length() >= sizeof(address.sun_path)) {
+            cout << "Socket path too long." << endl;
+            return false;
+        }
+        strcpy(address.sun_path, socketPath.c_str());
+        if (!removeSocket(socketPath)) {
+            cout << socketPath << " exists and is not a socket." << endl;
+            return false;
+        }
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0 ||
+            bind(listener, (sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(listener, 128) != 0) {
+            cout << "Cannot listen on " << socketPath << endl;
+            if (listener >= 0) ::close(listener);
+            return false;
+        }
+
+        int wake[2];
+        if (pipe(wake) != 0) {
+            cout << "Cannot create the wake pipe." << endl;
+            ::close(listener);
+            return false;
+        }
+        // a full pipe already has a wake-up pending, so writes may drop
+        fcntl(wake[1], F_SETFL, O_NONBLOCK);
+
+        int workers = max(DAEMON_MIN_WORKERS, workerCount());
+        ringbuffer<int> ready(4 * workers);
+        mutex returnedLock;
+        vector<int> returned;
+        vector<thread> pool;
+        for (int t = 0; t < workers; t++) {
+            pool.push_back(thread([&]() {
+                daemoncontext ctx;
+                ctx.request.reserve(DAEMON_BUFFER_SIZE);
+                ctx.response.reserve(DAEMON_BUFFER_SIZE);
+                int fd;
+                while (ready.pop(fd)) {
+                    if (!readMessage(fd, ctx.request)) {
+                        ::close(fd);
+                        continue;
+                    }
+                    handle(ctx);
+                    if (!writeMessage(fd, ctx.response)) {
+                        ::close(fd);
+                        continue;
+                    }
+                    {
+                        lock_guard<mutex> lock(returnedLock);
+                        returned.push_back(fd);
+                    }
+                    char c = 0;
+                    if (write(wake[1], &c, 1) < 0) {}  // may be full
+                }
+            }));
+        }
+        cout << "Listening on " << socketPath << " with " << workers
+             << " workers and " << dicts.size() << " dictionaries" << endl;
+        vector<pollfd> fds(2);
+        fds[0].fd = listener;
+        fds[1].fd = wake[0];
+        while (true) {
+            for (unsigned int i = 0; i < fds.size(); i++) {
+                fds[i].events = POLLIN;
+                fds[i].revents = 0;
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (fds[0].revents != 0) {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd < 0) break;
+                // a client that stalls mid-request must not hold a worker
+                timeval timeout = {DAEMON_RECEIVE_TIMEOUT, 0};
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                           sizeof(timeout));
+                pollfd p = {fd, POLLIN, 0};
+                fds.push_back(p);
+            }
+            // hand out the connections with a request (or a hang-up)
+            unsigned int kept = 2;
+            for (unsigned int i = 2; i < fds.size(); i++) {
+                if (fds[i].revents != 0) {
+                    ready.push(fds[i].fd);
+                } else {
+                    fds[kept++] = fds[i];
+                }
+            }
+            fds.resize(kept);
+            if (fds[1].revents != 0) {
+                char drain[256];
+                if (read(wake[0], drain, sizeof(drain)) < 0) {}
+                lock_guard<mutex> lock(returnedLock);
+                for (unsigned int i = 0; i < returned.size(); i++) {
+                    pollfd p = {returned[i], POLLIN, 0};
+                    fds.push_back(p);
+                }
+                returned.clear();
+            }
+        }
+        ready.close();
+        for (unsigned int t = 0; t < pool.size(); t++) pool[t].join();
+        for (unsigned int i = 2; i < fds.size(); i++) ::close(fds[i].fd);
+        ::close(wake[0]);
+        ::close(wake[1]);
+        ::close(listener);
+        removeSocket(socketPath);
+        return true;
+    }
+
+private:
+    //
+    // *This function serves the request in ctx.  Its response gets 4 bytes
+    // for the length prefix, the status and the payload.
+    //
+    void handle(daemoncontext &ctx) {
+        const vector<unsigned char> &request = ctx.request;
+        vector<unsigned char> &response = ctx.response;
+        auto start = chrono::steady_clock::now();
+        response.assign(5, 0);
+        char op = request.empty() ? 0 : (char)request[0];
+        bool ok = request.size() >= 5;
+        int id = -1;
+        if (ok) {
+            id = (int)(request[1] | (request[2] << 8) | (request[3] << 16) |
+                       ((uint32_t)request[4] << 24));
+        }
+        const unsigned char* payload = request.data() + 5;
+        size_t n = ok ? request.size() - 5 : 0;
+        string error;
+        if (!ok) {
+            error = "Malformed request.";
+        } else if (op == DAEMON_COMPRESS) {
+            const daemondictionary* dict = nullptr;
+            auto found = dicts.find(id);
+            if (id >= 0 && found == dicts.end()) {
+                error = "Unknown dictionary.";
+            } else if (id >= 0) {
+                dict = &found->second;
+            }
+            if (error == "") compressPayload(payload, n, dict, ctx, response);
+        } else if (op == DAEMON_DECOMPRESS) {
+            if (!decompressPayload(payload, n, dicts, ctx, response)) {
+                error = "Corrupt payload.";
+            }
+        } else if (op == DAEMON_STATS) {
+            string report = stats.report();
+            response.insert(response.end(), report.begin(), report.end());
+        } else {
+            error = "Unknown request.";
+        }
+        if (error != "") {
+            response.assign(5, 0);
+            response.insert(response.end(), error.begin(), error.end());
+        }
+        response[4] = error == "" ? DAEMON_OK : DAEMON_ERROR;
+        double micros = chrono::duration<double, micro>(
+            chrono::steady_clock::now() - start).count();
+        stats.record(op, micros, n, response.size() - 5, error == "");
+    }
+
+    map<int, daemondictionary> dicts;
+    latencystats stats;
+};
+
+//
+// The client library: one connection to a daemon.
+//
+class huffclient {
+public:
+    huffclient() : fd(-1) {}
+
+    ~huffclient() { disconnect(); }
+
+    //
+    // *This function connects to the daemon listening on socketPath.
+    // Returns false if there is none.
+    //
+    bool connect(string socketPath) {
+        disconnect();
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socketPath.length() >= sizeof(address.sun_path)) return false;
+        strcpy(address.sun_path, socketPath.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || ::connect(fd, (sockaddr*)&address,
+                                sizeof(address)) != 0) {
+            disconnect();
+            return false;
+        }
+        return true;
+    }
+
+    //
+    // *This function closes the connection.
+    //
+    void disconnect() {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+    }
+
+    //
+    // *This function compresses n bytes with dictionary dictId (-1 for
+    // none) into out.  Returns false on an error.
+    //
+    bool compress(const unsigned char* data, size_t n, int dictId,
+                  vector<unsigned char> &out) {
+        return call(DAEMON_COMPRESS, dictId, data, n, out);
+    }
+
+    //
+    // *This function decompresses a payload from compress into out.
+    // Returns false on an error.
+    //
+    bool decompress(const unsigned char* data, size_t n,
+                    vector<unsigned char> &out) {
+        return call(DAEMON_DECOMPRESS, -1, data, n, out);
+    }
+
+    //
+    // *This function fetches the daemon's statistics report.
+    //
+    bool stats(string &report) {
+        vector<unsigned char> out;
+        if (!call(DAEMON_STATS, -1, nullptr, 0, out)) return false;
+        report.assign(out.begin(), out.end());
+        return true;
+    }
+
+private:
+    //
+    // *This function sends one request and reads its response.  out gets the
+    // response payload, or the error message if the status is an error.
+    //
+    bool call(char op, int dictId, const unsigned char* data, size_t n,
+              vector<unsigned char> &out) {
+        if (fd < 0) return false;
+        message.assign(9, 0);
+        message[4] = (unsigned char)op;
+        for (int i = 0; i < 4; i++) {
+            message[5 + i] = (unsigned char)((uint32_t)dictId >> (8 * i));
+        }
+        if (n > 0) message.insert(message.end(), data, data + n);
+        if (!writeMessage(fd, message) || !readMessage(fd, out) ||
+            out.empty()) {
+            return false;
+        }
+        bool ok = out[0] == DAEMON_OK;
+        out.erase(out.begin());
+        return ok;
+    }
+
+    int fd;
+    vector<unsigned char> message;
+};
+
+//
+// *This function drives the daemon on socketPath with requests compress and
+// decompress round trips of payloadSize-byte slices of filename, from
+// threads connections, checking every result.  Prints throughput and
+// client-side latency percentiles.  Returns false if any request failed.
+//
+inline bool runLoadGenerator(string socketPath, string filename, int requests,
+                             int threads, size_t payloadSize, int dictId) {
+    vector<unsigned char> data;
+    if (!readFileBytes(filename, data)) return false;
+    if (data.empty()) {
+        cout << "Load generator needs a non-empty file." << endl;
+        return false;
+    }
+    payloadSize = max((size_t)1, min(payloadSize, data.size()));
+    threads = max(1, threads);
+    vector<vector<double> > latencies(threads);
+    atomic<int> failures(0);
+    atomic<size_t> compressedBytes(0);
+    auto start = chrono::steady_clock::now();
+    vector<thread> clients;
+    for (int t = 0; t < threads; t++) {
+        clients.push_back(thread([&, t]() {
+            huffclient client;
+            if (!client.connect(socketPath)) {
+                failures += requests / threads;
+                return;
+            }
+            vector<unsigned char> compressed, decompressed;
+            for (int r = t; r < requests; r += threads) {
+                size_t offset = ((size_t)r * payloadSize) %
+                                (data.size() - payloadSize + 1);
+                const unsigned char* slice = data.data() + offset;
+                auto before = chrono::steady_clock::now();
+                bool ok = client.compress(slice, payloadSize, dictId,
+                                          compressed);
+                auto middle = chrono::steady_clock::now();
+                ok = ok && client.decompress(compressed.data(),
+                                             compressed.size(),
+                                             decompressed);
+                auto after = chrono::steady_clock::now();
+                ok = ok && decompressed.size() == payloadSize &&
+                     memcmp(decompressed.data(), slice, payloadSize) == 0;
+                if (!ok) failures++;
+                compressedBytes += compressed.size();
+                latencies[t].push_back(chrono::duration<double, micro>(
+                    middle - before).count());
+                latencies[t].push_back(chrono::duration<double, micro>(
+                    after - middle).count());
+            }
+        }));
+    }
+    for (unsigned int t = 0; t < clients.size(); t++) clients[t].join();
+    double seconds = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+
+    vector<double> all;
+    for (int t = 0; t < threads; t++) {
+        all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+    }
+    sort(all.begin(), all.end());
+    double rawBytes = (double)requests * payloadSize;
+    cout << requests << " round trips of " << payloadSize << " bytes on "
+         << threads << " connections in " << seconds << " s: "
+         << 2 * requests / seconds << " requests/s, "
+         << 2 * rawBytes / seconds / (1024 * 1024) << " MB/s, ratio "
+         << compressedBytes / rawBytes << endl;
+    cout << "latency us p50 " << latencystats::percentile(all, 0.50)
+         << " p99 " << latencystats::percentile(all, 0.99)
+         << " max " << latencystats::percentile(all, 1.0) << ", "
+         << failures << " failures" << endl;
+    return failures == 0;
+}
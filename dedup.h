@@ -0,0 +1,369 @@
+//
+// dedup.h
+//
+// Deduplicating compression for files that share large identical regions
+// (disk images, repeated bundles, rotated logs).  Input is cut into chunks
+// at content-defined boundaries, so an insertion shifts only the chunks
+// around it, and each distinct chunk is compressed once into a chunk store
+// shared by every file.  A compressed file is then just a manifest listing
+// its chunks; a chunk the store already has costs a hash lookup, not a
+// compress.
+//
+// Chunk boundaries come from a Gear rolling hash, FastCDC style: no cut in
+// the first DEDUP_MIN_CHUNK bytes, a harder test (more mask bits) up to
+// DEDUP_AVG_CHUNK and an easier one after it, and a forced cut at
+// DEDUP_MAX_CHUNK.  This keeps chunk sizes close to the average.
+//
+// Store layout (a directory):
+//      chunks      block records (block.h), one per chunk, appended
+//      index       "<hash> <offset> <size>\n" per chunk, appended
+// Manifest layout (the ".huf" file):
+//      #M<store path length>:<store path>\n
+//      <raw size> <chunk count> <crc>\n
+//      <hash> <size>\n ...                                   per chunk
+// where hashes are 128 bits (two 64-bit content hashes) in hex.  The store
+// path is relative to the manifest's directory, so the manifest finds its
+// store from any working directory and the two can be moved together.
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <cstdlib>
+#include <climits>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "block.h"
+#include "checksum.h"
+#include "cache.h"
+#include "parallel.h"
+#include "util.h"
+
+using namespace std;
+
+const char DEDUP_MODE = 'M';
+const size_t DEDUP_MIN_CHUNK = 4 * 1024;
+const size_t DEDUP_AVG_CHUNK = 16 * 1024;
+const size_t DEDUP_MAX_CHUNK = 64 * 1024;
+const size_t DEDUP_BATCH = 4 * 1024 * 1024;
+const size_t DEDUP_BATCH_COST = 3;  // bytes held per byte of a batch
+const uint64_t DEDUP_MASK_HARD = ((1ULL << 16) - 1) << 48;  // 16 bits
+const uint64_t DEDUP_MASK_EASY = ((1ULL << 12) - 1) << 52;  // 12 bits
+
+//
+// The Gear table: a fixed pseudo-random 64-bit value per byte.
+//
+struct geartable {
+    uint64_t g[256];
+
+    geartable() {
+        uint64_t x = 0;
+        for (int i = 0; i < 256; i++) {  // splitmix64
+            uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            g[i] = z ^ (z >> 31);
+        }
+    }
+};
+
+//
+// *This function returns the length of the chunk at the start of n bytes
+// of data.  n must be all the data that is left, or at least
+// DEDUP_MAX_CHUNK bytes.
+//
+inline size_t chunkLength(const unsigned char* data, size_t n) {
+    static const geartable gear;
+    if (n <= DEDUP_MIN_CHUNK) return n;
+    size_t normal = min(n, DEDUP_AVG_CHUNK);
+    size_t end = min(n, DEDUP_MAX_CHUNK);
+    uint64_t h = 0;
+    size_t i = DEDUP_MIN_CHUNK;
+    for (; i < normal; i++) {
+        h = (h << 1) + gear.g[data[i]];
+        if ((h & DEDUP_MASK_HARD) == 0) return i + 1;
+    }
+    for (; i < end; i++) {
+        h = (h << 1) + gear.g[data[i]];
+        if ((h & DEDUP_MASK_EASY) == 0) return i + 1;
+    }
+    return end;
+}
+
+//
+// *This function returns the 128-bit hash that names a chunk, in hex.
+//
+inline string chunkName(const unsigned char* data, size_t n) {
+    return hashName(contentHash(data, n)) +
+           hashName(contentHash(data, n, HASH_PRIME1));
+}
+
+struct chunklocation {
+    size_t offset;  // of the chunk's block record in the chunks file
+    size_t size;
+};
+
+struct dedupstats {
+    size_t rawSize;
+    size_t chunks;
+    size_t newChunks;    // not in the store before
+    size_t storedBytes;  // added to the store
+};
+
+struct chunkstore {
+    string directory;
+    map<string, chunklocation> chunks;
+};
+
+//
+// *This function opens the chunk store in directory, creating it first if
+// create is true, and reads its index.  Returns false if it cannot be used.
+//
+inline bool openChunkStore(string directory, chunkstore &store, bool create) {
+    store.directory = directory;
+    store.chunks.clear();
+    if (create) mkdir(directory.c_str(), 0755);
+    struct stat info;
+    if (stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+        cout << "Cannot use chunk store: " << directory << endl;
+        return false;
+    }
+    ifstream input(directory + "/index");
+    string name;
+    chunklocation location;
+    while (input >> name >> location.offset >> location.size) {
+        store.chunks[name] = location;
+    }
+    return true;
+}
+
+//
+// *This function returns the directory part of path, "." if it has none.
+//
+inline string directoryOf(string path) {
+    size_t slash = path.rfind('/');
+    if (slash == string::npos) return ".";
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+//
+// *This function returns the path of to relative to the directory from.
+// Both are resolved first; if either cannot be, to is returned as given.
+//
+inline string relativePath(string from, string to) {
+    char resolved[PATH_MAX];
+    if (realpath(from.c_str(), resolved) == nullptr) return to;
+    string a = string(resolved) + "/";
+    if (realpath(to.c_str(), resolved) == nullptr) return to;
+    string b = string(resolved) + "/";
+    // the longest common prefix that ends at a component
+    size_t common = 0;
+    for (size_t i = 0; i < a.length() && i < b.length() && a[i] == b[i];
+         i++) {
+        if (a[i] == '/') common = i + 1;
+    }
+    string path;
+    for (size_t i = common; i < a.length(); i++) {
+        if (a[i] == '/') path += "../";
+    }
+    path += b.substr(common);
+    if (path.empty()) return ".";
+    return path.substr(0, path.length() - 1);  // without the last '/'
+}
+
+//
+// *This function returns the batch size that fits in budget bytes (0 for no
+// limit): at most DEDUP_BATCH and at least two of the largest chunk.
+//
+inline size_t dedupBatchSize(size_t budget) {
+    if (budget == 0) return DEDUP_BATCH;
+    return max(min(DEDUP_BATCH, budget / DEDUP_BATCH_COST),
+               2 * DEDUP_MAX_CHUNK);
+}
+
+//
+// *This function compresses filename into a manifest, filename + ".huf",
+// adding its new chunks to store, and adds its counts to stats.  Input is
+// read batch bytes at a time.  Returns false if the file cannot be read.
+//
+inline bool dedupCompressFile(string filename, chunkstore &store,
+                              dedupstats &stats, size_t batch = DEDUP_BATCH) {
+    ifstream input(filename, ios::binary);
+    if (!input.is_open()) {
+        cout << "File does not exist: " << filename << endl;
+        return false;
+    }
+    string chunksname = store.directory + "/chunks";
+    size_t chunksEnd = 0;
+    long long mtime;
+    fileStamp(chunksname, chunksEnd, mtime);
+    ofstream chunksFile(chunksname, ios::binary | ios::app);
+    ofstream indexFile(store.directory + "/index", ios::app);
+    ostringstream manifest;
+    size_t chunkCount = 0;
+    size_t rawSize = 0;
+    uint32_t checksum = 0;
+
+    vector<unsigned char> buffer;
+    bool eof = false;
+    while (!eof || !buffer.empty()) {
+        // fill up to a batch and cut it, keeping a tail that might not end
+        // at a boundary for the next round
+        size_t have = buffer.size();
+        if (!eof) {
+            buffer.resize(have + batch);
+            input.read((char*)buffer.data() + have, batch);
+            buffer.resize(have + (size_t)input.gcount());
+            eof = !input;
+        }
+        vector<size_t> starts, lengths;
+        size_t used = 0;
+        while (used < buffer.size() &&
+               (eof || buffer.size() - used >= DEDUP_MAX_CHUNK)) {
+            size_t n = chunkLength(buffer.data() + used,
+                                   buffer.size() - used);
+            starts.push_back(used);
+            lengths.push_back(n);
+            used += n;
+        }
+        int count = (int)starts.size();
+        vector<string> names(count);
+        parallelFor(count, [&](int i) {
+            names[i] = chunkName(buffer.data() + starts[i], lengths[i]);
+        });
+        vector<int> fresh;
+        set<string> queued;
+        for (int i = 0; i < count; i++) {
+            if (store.chunks.count(names[i]) == 0 &&
+                queued.insert(names[i]).second) {
+                fresh.push_back(i);
+            }
+        }
+        vector<string> coded(fresh.size());
+        parallelFor((int)fresh.size(), [&](int k) {
+            int i = fresh[k];
+            huffblock block;
+            encodeBlock(buffer.data() + starts[i], lengths[i], block);
+            ostringstream ss;
+            writeBlock(ss, block);
+            coded[k] = ss.str();
+        });
+        for (unsigned int k = 0; k < fresh.size(); k++) {
+            int i = fresh[k];
+            chunklocation location = {chunksEnd, lengths[i]};
+            store.chunks[names[i]] = location;
+            chunksFile << coded[k];
+            indexFile << names[i] << ' ' << location.offset << ' '
+                      << location.size << '\n';
+            chunksEnd += coded[k].size();
+            stats.storedBytes += coded[k].size();
+        }
+        for (int i = 0; i < count; i++) {
+            manifest << names[i] << ' ' << lengths[i] << '\n';
+        }
+        checksum = crc32c(checksum, buffer.data(), used);
+        rawSize += used;
+        chunkCount += count;
+        stats.newChunks += fresh.size();
+        buffer.erase(buffer.begin(), buffer.begin() + used);
+    }
+
+    string storePath = relativePath(directoryOf(filename), store.directory);
+    ofstream output(filename + ".huf", ios::binary);
+    output << HEADER_TAG << DEDUP_MODE << storePath.length() << ':'
+           << storePath << '\n' << rawSize << ' ' << chunkCount << ' '
+           << hex << checksum << dec << '\n' << manifest.str();
+    stats.rawSize += rawSize;
+    stats.chunks += chunkCount;
+    return true;
+}
+
+//
+// *This function compresses files through the chunk store in directory,
+// batch bytes at a time, and prints how much of them was already there.
+// Returns false if the store or a file cannot be used.
+//
+inline bool dedupCompress(string directory, const vector<string> &files,
+                          size_t batch = DEDUP_BATCH) {
+    chunkstore store;
+    if (!openChunkStore(directory, store, true)) return false;
+    dedupstats stats = {0, 0, 0, 0};
+    bool ok = true;
+    for (unsigned int i = 0; i < files.size(); i++) {
+        ok = dedupCompressFile(files[i], store, stats, batch) && ok;
+    }
+    cout << stats.rawSize << " bytes in " << stats.chunks << " chunks, "
+         << stats.newChunks << " new (" << stats.storedBytes
+         << " bytes added to the store)";
+    if (stats.newChunks > 0) {
+        cout << ", dedup factor " << (double)stats.chunks / stats.newChunks;
+    }
+    cout << endl;
+    return ok;
+}
+
+//
+// *This function restores a manifest, filename, from its chunk store.
+// Returns false if it is not a manifest or a chunk is missing or corrupt.
+//
+inline bool dedupDecompress(string filename, bool verify = false) {
+    string manifestname = filename.substr(0, filename.find(".huf")) + ".huf";
+    ifstream input(manifestname, ios::binary);
+    size_t length = 0, rawSize = 0, count = 0;
+    uint32_t checksum = 0;
+    if (input.get() != HEADER_TAG || input.get() != DEDUP_MODE ||
+        !(input >> length) || input.get() != ':' ||
+        length == 0 || length > bytesLeft(input)) {
+        cout << "Not a dedup manifest." << endl;
+        return false;
+    }
+    string directory(length, 0);
+    input.read(&directory[0], length);
+    input >> rawSize >> count >> hex >> checksum >> dec;
+    // the store path is relative to the manifest
+    if (directory[0] != '/') {
+        directory = directoryOf(manifestname) + "/" + directory;
+    }
+    chunkstore store;
+    if (!input) {
+        cout << "Not a dedup manifest." << endl;
+        return false;
+    }
+    if (!openChunkStore(directory, store, false)) return false;
+    ifstream chunksFile(directory + "/chunks", ios::binary);
+    ofstream output(uncompressedFilename(filename), ios::binary);
+    huffblock block;
+    vector<unsigned char> out;
+    uint32_t actual = 0;
+    size_t written = 0;
+    for (size_t i = 0; i < count; i++) {
+        string name;
+        size_t size;
+        input >> name >> size;
+        auto found = store.chunks.find(name);
+        if (found == store.chunks.end()) {
+            cout << "Missing chunk: " << name << endl;
+            return false;
+        }
+        chunksFile.clear();
+        chunksFile.seekg(found->second.offset);
+        if (!readBlock(chunksFile, block, DEDUP_MAX_CHUNK) ||
+            !decodeBlock(block, out, verify) || out.size() != size) {
+            cout << "Corrupt chunk: " << name << endl;
+            return false;
+        }
+        writeBytes(output, out.data(), out.size());
+        actual = crc32c(actual, out.data(), out.size());
+        written += out.size();
+    }
+    if (written != rawSize || actual != checksum) {
+        cout << "Checksum mismatch." << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,171 @@
+//
+// dictionary.h
+//
+// Pretrained Huffman dictionaries for small inputs.  A dictionary is a
+// frequency map trained once over a sample corpus and saved to disk with a
+// numeric id.  Files compressed with a dictionary carry only that id in their
+// header ("#D<id>\n") instead of the full textual frequency map, and the tree
+// and encoding map are built once when the dictionary is loaded rather than
+// once per message.
+//
+// Dictionary file format:
+//      HUFDICT <id>
+//      {k:v, k:v, ...}
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "hashmap.h"
+#include "bitstream.h"
+#include "util.h"
+
+using namespace std;
+
+const char DICTIONARY_MODE = 'D';
+const size_t DICTIONARY_MEMORY_COST = 8;  // bytes held per byte of input
+
+struct huffdict {
+    int id;
+    hashmapF frequencyMap;
+    HuffmanNode* encodingTree;
+    hashmapE encodingMap;
+};
+
+//
+// *This function trains a dictionary from the files in corpus and saves it to
+// dictname.  Every byte value is given a count of at least one so that inputs
+// containing bytes the corpus never saw can still be encoded.
+//
+inline bool trainDictionary(vector<string> corpus, int id, string dictname) {
+    hashmapF frequencyMap;
+    for (unsigned int i = 0; i < corpus.size(); i++) {
+        ifstream infile(corpus[i]);
+        if (!infile.is_open()) {
+            cout << "File does not exist: " << corpus[i] << endl;
+            return false;
+        }
+        while (true) {
+            char c = infile.get();
+            if (c == EOF) break;
+            _buildFrequencyMap(c, frequencyMap);
+        }
+    }
+    // smoothing: keys are char values, the same way buildFrequencyMap
+    // stores them.
+    for (int i = 0; i < 256; i++) {
+        char c = (char)i;
+        if (!frequencyMap.containsKey(c)) frequencyMap.put(c, 1);
+    }
+    frequencyMap.put(PSEUDO_EOF, 1);
+
+    ofstream output(dictname);
+    if (!output.is_open()) {
+        cout << "Cannot write dictionary: " << dictname << endl;
+        return false;
+    }
+    output << "HUFDICT " << id << endl;
+    output << frequencyMap;
+    output.close();
+    return true;
+}
+
+//
+// *This function loads a dictionary from dictname and builds its encoding
+// tree and encoding map.  Returns false if the file is not a dictionary.
+// The tree must be released with freeDictionary.
+//
+inline bool loadDictionary(string dictname, huffdict &dict) {
+    dict.encodingTree = nullptr;
+    ifstream input(dictname);
+    string magic;
+    if (!input.is_open() || !(input >> magic >> dict.id) ||
+        magic != "HUFDICT") {
+        cout << "Not a dictionary file: " << dictname << endl;
+        return false;
+    }
+    input.get();  // newline
+    input >> dict.frequencyMap;
+    dict.encodingTree = buildEncodingTree(dict.frequencyMap);
+    dict.encodingMap = buildEncodingMap(dict.encodingTree);
+    return true;
+}
+
+//
+// *This function frees the encoding tree owned by a loaded dictionary.
+//
+inline void freeDictionary(huffdict &dict) {
+    freeTree(dict.encodingTree);
+    dict.encodingTree = nullptr;
+}
+
+//
+// *This function reads a "#D<id>\n" header from input.  Returns the id, or -1
+// if input does not start with a dictionary header.
+//
+inline int readDictionaryHeader(istream &input) {
+    if (input.peek() != HEADER_TAG) return -1;
+    input.get();
+    if (input.get() != DICTIONARY_MODE) return -1;
+    int id = -1;
+    input >> id;
+    input.get();  // newline
+    return id;
+}
+
+//
+// *This function returns the dictionary id in the header of a file written
+// by compressWithDictionary, or -1 if it has none.
+//
+inline int dictionaryFileId(string filename) {
+    ifstream input(filename.substr(0, filename.find(".huf")) + ".huf",
+                   ios::binary);
+    return readDictionaryHeader(input);
+}
+
+//
+// *This function checks that a file written with dictionary id can be read
+// with dict, and says so if not.
+//
+inline bool checkDictionaryId(int id, const huffdict &dict) {
+    if (id == dict.id) return true;
+    cout << "Dictionary id mismatch: file uses " << id
+         << ", dictionary is " << dict.id << endl;
+    return false;
+}
+
+//
+// *This function compresses filename into (filename + ".huf") using a loaded
+// dictionary.  Only the dictionary id is written in the header.  Returns a
+// string version of the bit pattern, like compress.
+//
+inline string compressWithDictionary(string filename, huffdict &dict) {
+    ifstream input(filename);
+    if (!input.is_open()) {
+        cout << "File does not exist." << endl;
+        return "";
+    }
+    ofbitstream output(filename + ".huf");
+    output << HEADER_TAG << DICTIONARY_MODE << dict.id << '\n';
+    int size = 0;
+    string codeStr = encode(input, dict.encodingMap, output, size, true);
+    output.close();
+    return codeStr;
+}
+
+//
+// *This function decompresses a file written by compressWithDictionary.  The
+// output is named the same way decompress names it.  Returns a string version
+// of the uncompressed file, or "" if the file was compressed with another
+// dictionary.
+//
+inline string decompressWithDictionary(string filename, huffdict &dict) {
+    ifbitstream input(filename.substr(0, filename.find(".huf")) + ".huf");
+    if (!checkDictionaryId(readDictionaryHeader(input), dict)) return "";
+    ofstream output(uncompressedFilename(filename));
+    string decodeStr = decode(input, dict.encodingTree, output);
+    output.close();
+    return decodeStr;
+}
@@ -0,0 +1,269 @@
+//
+// estimate.h
+//
+// A dry run of compress: "program.exe estimate [--sample <KB>] <files...>"
+// prints what each file would compress to without coding or writing
+// anything.  Every size here follows from byte counts and code lengths:
+//      legacy   compress's output: its frequency map header and the bits
+//               of its Huffman code, exact
+//      codec    the buffer codec (codec.h), exact
+//      blocks   compress --blocks: each block planned and its backend chosen
+//               as blockCompress would, plus the record and index framing;
+//               exact for Huffman and stored blocks, tANS sizes are the
+//               coder's own cost estimate
+//      H0, H1   order-0 and order-1 entropy of the bytes, in bytes: the
+//               floor for any coder of single bytes, and a hint of what the
+//               context modes (--lz, --bwt) might reach
+// Input is read one block at a time and nothing is kept, so memory stays
+// bounded.  With --sample, only about that many KB are read, in
+// ESTIMATE_SAMPLES pieces spread evenly over the file, and every size is
+// scaled up from them (and marked with a "~").
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <queue>
+#include <functional>
+#include <stdint.h>
+#include "block.h"
+#include "codec.h"
+#include "util.h"
+
+using namespace std;
+
+const int ESTIMATE_SAMPLES = 16;
+
+struct sizeestimate {
+    size_t rawSize;
+    size_t sampled;      // bytes read
+    size_t legacySize;
+    size_t codecSize;
+    size_t blockSize;
+    double entropy0;     // bytes
+    double entropy1;     // bytes
+};
+
+//
+// *This function returns the number of decimal digits in n.
+//
+inline int decimalDigits(size_t n) {
+    int d = 1;
+    for (; n >= 10; n /= 10) d++;
+    return d;
+}
+
+//
+// *This function returns the number of hex digits in n.
+//
+inline int hexDigits(uint32_t n) {
+    int d = 1;
+    for (; n >= 16; n /= 16) d++;
+    return d;
+}
+
+//
+// *This function returns the bits of a Huffman code for symbols with the
+// given counts.  Every Huffman tree for the counts has the same cost, the
+// sum of the weights of its internal nodes, so no tree is built; counts
+// are 64-bit, unlike HuffmanNode's.
+//
+inline uint64_t huffmanBits(const vector<uint64_t> &counts) {
+    priority_queue<uint64_t, vector<uint64_t>, greater<uint64_t> > pq;
+    for (unsigned int s = 0; s < counts.size(); s++) {
+        if (counts[s] > 0) pq.push(counts[s]);
+    }
+    uint64_t bits = 0;
+    while (pq.size() > 1) {
+        uint64_t a = pq.top();
+        pq.pop();
+        uint64_t b = pq.top();
+        pq.pop();
+        bits += a + b;
+        pq.push(a + b);
+    }
+    return bits;
+}
+
+//
+// *This function returns the size compress writes for text with the byte
+// counts counts: its "{k:v, ...}" header, keyed by signed char, and the
+// code.  compress stops at the first 0xFF byte, so for its output the
+// counts must end there.
+//
+inline size_t legacySize(const vector<uint64_t> &counts) {
+    vector<uint64_t> symbols(counts.begin(), counts.begin() + 256);
+    symbols.push_back(1);  // PSEUDO_EOF
+    size_t header = 2 + 3 + 1 + 1;  // {}, "256:1"
+    for (int b = 0; b < 256; b++) {
+        if (counts[b] == 0) continue;
+        int key = (char)b;
+        header += (key < 0) + decimalDigits(abs(key)) + 1 +
+                  decimalDigits(counts[b]) + 2;
+    }
+    return header + (huffmanBits(symbols) + 7) / 8;
+}
+
+//
+// *This function estimates the compressed sizes of filename, reading only
+// about sampleBytes of it if sampleBytes is not 0.  Returns false if it
+// cannot be read.
+//
+inline bool estimateFile(string filename, size_t sampleBytes, sizeestimate &e) {
+    ifstream input(filename, ios::binary);
+    if (!input.is_open()) {
+        cout << "File does not exist: " << filename << endl;
+        return false;
+    }
+    input.seekg(0, ios::end);
+    size_t n = (size_t)input.tellg();
+    input.seekg(0);
+
+    // the pieces to read: every block, or ESTIMATE_SAMPLES spread out
+    vector<size_t> starts;
+    size_t pieceSize = BLOCK_DEFAULT_SIZE;
+    if (sampleBytes == 0 || sampleBytes >= n) {
+        for (size_t start = 0; start < n; start += pieceSize) {
+            starts.push_back(start);
+        }
+    } else {
+        pieceSize = min((size_t)BLOCK_DEFAULT_SIZE,
+                        max((size_t)1, sampleBytes / ESTIMATE_SAMPLES));
+        for (int i = 0; i < ESTIMATE_SAMPLES; i++) {
+            starts.push_back((n - pieceSize) / (ESTIMATE_SAMPLES - 1) * i);
+        }
+    }
+
+    vector<uint64_t> counts(256, 0), legacyCounts(256, 0);
+    vector<uint64_t> pairs(256 * 256, 0);
+    size_t sampled = 0;
+    size_t legacyEnd = n, legacySampled = 0;  // compress stops at 0xFF
+    size_t tables = 0, payloads = 0, records = 0;
+    blocktable previous = {0, hashmapF()};
+    vector<unsigned char> piece(pieceSize);
+    for (unsigned int i = 0; i < starts.size(); i++) {
+        input.seekg(starts[i]);
+        input.read((char*)piece.data(), pieceSize);
+        size_t got = (size_t)input.gcount();
+        if (got == 0) break;
+        input.clear();
+        const unsigned char* data = piece.data();
+        for (size_t j = 0; j < got; j++) counts[data[j]]++;
+        for (size_t j = 1; j < got; j++) {
+            pairs[data[j - 1] * 256 + data[j]]++;
+        }
+        if (starts[i] < legacyEnd) {
+            size_t j = 0;
+            for (; j < got && data[j] != 0xFF; j++) legacyCounts[data[j]]++;
+            legacySampled += j;
+            if (j < got) legacyEnd = starts[i] + j;
+        }
+
+        huffblock block;
+        blockplan plan;
+        planBlock(data, got, block, plan);
+        chooseBackend(plan, block, &previous);
+        keepTable(block, previous);
+        size_t table = tableSize(block.table);
+        size_t payload = plan.codedSize - table;
+        tables += table;
+        payloads += payload;
+        // <backend>[filter]<raw size>{table}<size> <crc> <crc>\n, where the
+        // payload's crc is taken to have all 8 digits
+        records += 1 + (block.filter != FILTER_NONE) + decimalDigits(got) +
+                   decimalDigits(payload) + 1 + hexDigits(block.rawChecksum) +
+                   1 + (payload > 0 ? 8 : 1) + 1;
+        sampled += got;
+    }
+
+    e.rawSize = n;
+    e.sampled = sampled;
+    double scale = sampled > 0 ? (double)n / sampled : 0;
+    double legacyScale = legacySampled > 0 ?
+                         (double)legacyEnd / legacySampled : 0;
+    for (int b = 0; b < 256; b++) {
+        legacyCounts[b] = (uint64_t)llround(legacyCounts[b] * legacyScale);
+    }
+    e.legacySize = legacySize(legacyCounts);
+
+    vector<uint64_t> scaled(256);
+    for (int b = 0; b < 256; b++) {
+        scaled[b] = (uint64_t)llround(counts[b] * scale);
+    }
+    huffcontext* ctx = new huffcontext;
+    e.codecSize = codecSize(scaled.data(), n, *ctx);
+    delete ctx;
+
+    // blocks: payloads scale with the bytes, tables and records with the
+    // number of blocks
+    size_t blocks = (n + BLOCK_DEFAULT_SIZE - 1) / BLOCK_DEFAULT_SIZE;
+    double perBlock = starts.empty() ? 0 :
+                      (double)(tables + records) / starts.size();
+    size_t body = (size_t)llround(payloads * scale + perBlock * blocks);
+    size_t header = 3 + decimalDigits(BLOCK_DEFAULT_SIZE);
+    // offsets in the index average about half the largest
+    size_t index = 4 + decimalDigits(blocks) + decimalDigits(n) +
+                   decimalDigits(body) + FOOTER_SIZE +
+                   blocks * (2 + decimalDigits(n / 2) +
+                             decimalDigits(body / 2));
+    e.blockSize = header + body + index;
+
+    double h0 = 0, h1 = 0;
+    for (int a = 0; a < 256; a++) {
+        if (counts[a] == 0) continue;
+        h0 += counts[a] * log2((double)sampled / counts[a]);
+        uint64_t row = 0;
+        for (int b = 0; b < 256; b++) row += pairs[a * 256 + b];
+        for (int b = 0; b < 256; b++) {
+            uint64_t c = pairs[a * 256 + b];
+            if (c > 0) h1 += c * log2((double)row / c);
+        }
+    }
+    e.entropy0 = h0 * scale / 8;
+    e.entropy1 = h1 * scale / 8;
+    return true;
+}
+
+//
+// *This function prints one size, with a "~" if it was scaled from a
+// sample.
+//
+inline void printEstimate(double size, bool sampledOnly, int width) {
+    ostringstream ss;
+    ss << (sampledOnly ? "~" : "") << (size_t)llround(size);
+    cout << setw(width) << ss.str();
+}
+
+//
+// *This function estimates every file in files and prints a line for each.
+// Returns false if one cannot be read.
+//
+inline bool estimateFiles(const vector<string> &files, size_t sampleBytes) {
+    cout << left << setw(24) << "file" << right << setw(12) << "raw"
+         << setw(12) << "legacy" << setw(12) << "codec" << setw(12)
+         << "blocks" << setw(12) << "H0" << setw(12) << "H1" << endl;
+    bool ok = true;
+    for (unsigned int i = 0; i < files.size(); i++) {
+        sizeestimate e;
+        if (!estimateFile(files[i], sampleBytes, e)) {
+            ok = false;
+            continue;
+        }
+        bool sampledOnly = e.sampled < e.rawSize;
+        cout << left << setw(24) << files[i] << right << setw(12)
+             << e.rawSize;
+        printEstimate(e.legacySize, sampledOnly, 12);
+        printEstimate(e.codecSize, sampledOnly, 12);
+        printEstimate(e.blockSize, sampledOnly, 12);
+        printEstimate(e.entropy0, sampledOnly, 12);
+        printEstimate(e.entropy1, sampledOnly, 12);
+        cout << endl;
+    }
+    return ok;
+}
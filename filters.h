@@ -0,0 +1,160 @@
+//
+// filters.h
+//
+// Reversible pre-filters for numeric binary data.  Arrays of int32s or
+// floats look almost random byte by byte, but their high bytes barely
+// change and neighbouring values are close.  Before a block's bytes are
+// counted, one of these filters can be applied:
+//      shuffle k   byte-plane shuffle: all first bytes of the k-byte
+//                  elements, then all second bytes, and so on
+//      delta s     each byte minus the byte s positions earlier
+// or a shuffle followed by a byte delta.  The filter is picked per block by
+// the order-0 entropy of the filtered bytes and recorded as one letter in
+// the block record.
+//
+// The loops are plain strided array loops with no data-dependent branches,
+// so the compiler can vectorize the forward passes.
+//
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+
+using namespace std;
+
+const char FILTER_NONE = 0;
+const size_t FILTER_SAMPLE_SIZE = 16 * 1024;
+
+struct filterspec {
+    char id;      // letter written in the block record
+    int shuffle;  // element size for the byte-plane shuffle, 0 for none
+    int delta;    // delta stride, 0 for none
+};
+
+const filterspec FILTERS[] = {
+    {'a', 0, 1}, {'b', 0, 2}, {'c', 0, 4}, {'d', 0, 8},
+    {'p', 2, 0}, {'q', 4, 0}, {'r', 8, 0},
+    {'s', 2, 1}, {'t', 4, 1}, {'u', 8, 1},
+};
+const int FILTER_COUNT = sizeof(FILTERS) / sizeof(FILTERS[0]);
+
+//
+// *This function returns the spec for a filter letter, or nullptr if there
+// is none.
+//
+inline const filterspec* findFilter(char id) {
+    for (int i = 0; i < FILTER_COUNT; i++) {
+        if (FILTERS[i].id == id) return &FILTERS[i];
+    }
+    return nullptr;
+}
+
+//
+// *This function shuffles the whole k-byte elements of in into byte planes.
+// Trailing bytes that do not fill an element are copied as they are.
+//
+inline void shuffleBytes(const unsigned char* in, size_t n, int k,
+                         unsigned char* out) {
+    size_t elements = n / k;
+    for (int b = 0; b < k; b++) {
+        unsigned char* plane = out + b * elements;
+        for (size_t i = 0; i < elements; i++) plane[i] = in[i * k + b];
+    }
+    memcpy(out + elements * k, in + elements * k, n - elements * k);
+}
+
+//
+// *This function is the inverse of shuffleBytes.
+//
+inline void unshuffleBytes(const unsigned char* in, size_t n, int k,
+                           unsigned char* out) {
+    size_t elements = n / k;
+    for (int b = 0; b < k; b++) {
+        const unsigned char* plane = in + b * elements;
+        for (size_t i = 0; i < elements; i++) out[i * k + b] = plane[i];
+    }
+    memcpy(out + elements * k, in + elements * k, n - elements * k);
+}
+
+//
+// *This function replaces each byte with its difference from the byte
+// stride positions earlier, in place.  Runs backwards so every difference
+// uses an original byte.
+//
+inline void deltaEncode(unsigned char* data, size_t n, int stride) {
+    for (size_t i = n; i-- > (size_t)stride;) {
+        data[i] = (unsigned char)(data[i] - data[i - stride]);
+    }
+}
+
+//
+// *This function is the inverse of deltaEncode, in place.
+//
+inline void deltaDecode(unsigned char* data, size_t n, int stride) {
+    for (size_t i = stride; i < n; i++) {
+        data[i] = (unsigned char)(data[i] + data[i - stride]);
+    }
+}
+
+//
+// *This function applies a filter to n bytes of in, writing out.
+//
+inline void applyFilter(const filterspec &filter, const unsigned char* in,
+                        size_t n, unsigned char* out) {
+    if (filter.shuffle > 0) {
+        shuffleBytes(in, n, filter.shuffle, out);
+    } else {
+        memcpy(out, in, n);
+    }
+    if (filter.delta > 0) deltaEncode(out, n, filter.delta);
+}
+
+//
+// *This function undoes applyFilter in place.
+//
+inline void undoFilter(const filterspec &filter, vector<unsigned char> &data) {
+    if (filter.delta > 0) deltaDecode(data.data(), data.size(), filter.delta);
+    if (filter.shuffle > 0) {
+        vector<unsigned char> out(data.size());
+        unshuffleBytes(data.data(), data.size(), filter.shuffle, out.data());
+        data.swap(out);
+    }
+}
+
+//
+// *This function estimates the order-0 entropy coded size of n bytes, in
+// bits.
+//
+inline double entropyBits(const unsigned char* data, size_t n) {
+    size_t counts[256] = {0};
+    for (size_t i = 0; i < n; i++) counts[data[i]]++;
+    double bits = 0;
+    for (int s = 0; s < 256; s++) {
+        if (counts[s] > 0) bits += counts[s] * log2((double)n / counts[s]);
+    }
+    return bits;
+}
+
+//
+// *This function picks the filter for a block by trying each one on a sample
+// from the start of the block.  Returns FILTER_NONE unless a filter saves at
+// least 2% on the sample.
+//
+inline char chooseFilter(const unsigned char* data, size_t n) {
+    size_t sample = min(n, FILTER_SAMPLE_SIZE);
+    if (sample < 64) return FILTER_NONE;
+    double best = entropyBits(data, sample) * 0.98;
+    char bestId = FILTER_NONE;
+    vector<unsigned char> filtered(sample);
+    for (int i = 0; i < FILTER_COUNT; i++) {
+        applyFilter(FILTERS[i], data, sample, filtered.data());
+        double bits = entropyBits(filtered.data(), sample);
+        if (bits < best) {
+            best = bits;
+            bestId = FILTERS[i].id;
+        }
+    }
+    return bestId;
+}
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "flattree.h"
+
+using namespace std;
+
+//
+// *This function returns node's entry in its parent: a leaf entry for a
+// leaf, otherwise index.
+//
+uint16_t flatEntry(HuffmanNode* node, int index) {
+    if (node->character == NOT_A_CHAR) return (uint16_t)index;
+    return (uint16_t)(FLAT_LEAF | (node->character & (FLAT_LEAF - 1)));
+}
+
+//
+// *This function lays out tree's internal nodes in nodes, breadth first,
+// with queue (as long as nodes) for the HuffmanNode of each.  Nothing is
+// allocated, so the codec can flatten into its context.  Returns the
+// number of nodes, 0 for a one-leaf or empty tree, or -1 if the tree does
+// not fit in capacity nodes or has a symbol that cannot be flattened.
+//
+int flattenNodes(HuffmanNode* tree, flatnode* nodes, HuffmanNode** queue,
+                 int capacity) {
+    if (tree == nullptr || tree->character != NOT_A_CHAR) return 0;
+    capacity = min(capacity, FLAT_MAX_NODES);
+    int used = 1;
+    queue[0] = tree;
+    for (int i = 0; i < used; i++) {
+        HuffmanNode* children[2] = {queue[i]->zero, queue[i]->one};
+        for (int b = 0; b < 2; b++) {
+            HuffmanNode* child = children[b];
+            if (child == nullptr) {
+                nodes[i].child[b] = 0;
+                continue;
+            }
+            if (child->character != NOT_A_CHAR) {
+                if (child->character < FLAT_MIN_SYMBOL ||
+                    child->character > FLAT_MAX_SYMBOL) {
+                    return -1;
+                }
+                nodes[i].child[b] = flatEntry(child, 0);
+                continue;
+            }
+            if (used == capacity) return -1;
+            nodes[i].child[b] = flatEntry(child, used);
+            queue[used++] = child;
+        }
+    }
+    return used;
+}
+
+//
+// *This function flattens tree into flat.  Returns false if the tree is
+// empty or cannot be flattened.
+//
+bool flattenTree(HuffmanNode* tree, flattree &flat) {
+    flat.root = 0;
+    flat.rootCount = 0;
+    flat.nodes.clear();
+    flat.counts.clear();
+    if (tree == nullptr) return false;
+    if (tree->character != NOT_A_CHAR &&
+        (tree->character < FLAT_MIN_SYMBOL ||
+         tree->character > FLAT_MAX_SYMBOL)) {
+        return false;
+    }
+    flat.root = flatEntry(tree, 0);
+    flat.rootCount = tree->count;
+    // a full tree has one internal node fewer than leaves, so the nodes are
+    // sized as it is flattened
+    vector<HuffmanNode*> queue;
+    for (int capacity = 256; ; capacity *= 2) {
+        flat.nodes.resize(capacity);
+        queue.resize(capacity);
+        int used = flattenNodes(tree, flat.nodes.data(), queue.data(),
+                                capacity);
+        if (used >= 0) {
+            flat.nodes.resize(used);
+            break;
+        }
+        if (capacity >= FLAT_MAX_NODES) {
+            flat.nodes.clear();
+            return false;
+        }
+    }
+    flat.counts.resize(2 * flat.nodes.size());
+    for (unsigned int i = 0; i < flat.nodes.size(); i++) {
+        flat.counts[2 * i] = queue[i]->zero ? queue[i]->zero->count : 0;
+        flat.counts[2 * i + 1] = queue[i]->one ? queue[i]->one->count : 0;
+    }
+    return true;
+}
+
+//
+// *Recursive helper function for building the encoding map from a
+// flattened tree.
+//
+void _buildEncodingMap(const flattree &tree, uint16_t entry,
+                       hashmapE &encodingMap, string str) {
+    if (entry & FLAT_LEAF) {
+        encodingMap[flatSymbol(entry)] = str;
+        return;
+    }
+    for (int b = 0; b < 2; b++) {
+        uint16_t child = tree.nodes[entry].child[b];
+        if (child != 0) {
+            _buildEncodingMap(tree, child, encodingMap,
+                              str + (char)('0' + b));
+        }
+    }
+}
+
+//
+// *This function builds the encoding map from a flattened tree, the same
+// map buildEncodingMap builds from the tree it came from.
+//
+hashmapE buildEncodingMap(const flattree &tree) {
+    hashmapE encodingMap;
+    if ((tree.root & FLAT_LEAF) || !tree.nodes.empty()) {
+        _buildEncodingMap(tree, tree.root, encodingMap, "");
+    }
+    return encodingMap;
+}
+
+//
+// *This function decodes the input stream into the output stream with a
+// flattened tree, as decode does with the tree it came from.
+//
+string decode(ifbitstream &input, const flattree &tree, ofstream &output) {
+    string result = "";
+    uint16_t entry = tree.root;
+    while (input) {
+        int c = input.readBit();
+        if (entry & FLAT_LEAF) {
+            int character = flatSymbol(entry);
+            if (character == PSEUDO_EOF) break;  // stop if we read EOF
+            result += character;
+            output << (char)character;
+            entry = tree.root;
+        }
+        if ((c == 0 || c == 1) && !(entry & FLAT_LEAF)) {
+            entry = tree.nodes[entry].child[c];
+        }
+    }
+    return result;
+}
@@ -0,0 +1,87 @@
+//
+// flattree.h
+//
+// A flattened Huffman tree for decoding.  HuffmanNode trees are built with a
+// "new" per node, 24 bytes each and scattered over the heap, so walking one
+// a bit at a time can miss the cache on every bit.  A flattree keeps only
+// the internal nodes, in one array in breadth-first order from the root, so
+// the top levels every code passes through share a few cache lines:
+//      - a node is two 16-bit child entries, 4 bytes;
+//      - an entry with FLAT_LEAF set is a leaf and holds its symbol in the
+//        low 15 bits (two's complement, so compress's negative char keys
+//        fit); otherwise it is the index of an internal node;
+//      - index 0 is the root, which is never a child, so a child entry of 0
+//        means there is no such code.
+// Counts are only wanted for printing, so they are kept apart from the
+// nodes.  A tree with more than FLAT_MAX_NODES internal nodes, or a symbol
+// outside FLAT_MIN_SYMBOL..FLAT_MAX_SYMBOL, cannot be flattened.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "bitbuffer.h"
+#include "bitstream.h"
+#include "util.h"
+
+using namespace std;
+
+const uint16_t FLAT_LEAF = 0x8000;
+const int FLAT_MAX_NODES = 0x8000;
+const int FLAT_MIN_SYMBOL = -0x4000;
+const int FLAT_MAX_SYMBOL = 0x3FFF;
+
+struct flatnode {
+    uint16_t child[2];  // the zero and one children's entries
+};
+
+struct flattree {
+    uint16_t root;            // 0, or a leaf entry for a one-leaf tree
+    vector<flatnode> nodes;
+    vector<int> counts;       // counts[2 * i + bit]: node i's child's count
+    int rootCount;
+};
+
+int flattenNodes(HuffmanNode* tree, flatnode* nodes, HuffmanNode** queue,
+                 int capacity);
+bool flattenTree(HuffmanNode* tree, flattree &flat);
+uint16_t flatEntry(HuffmanNode* node, int index);
+void _buildEncodingMap(const flattree &tree, uint16_t entry,
+                       hashmapE &encodingMap, string str);
+hashmapE buildEncodingMap(const flattree &tree);
+string decode(ifbitstream &input, const flattree &tree, ofstream &output);
+
+//
+// *This function returns true if tree has no codes (it was empty or could
+// not be flattened).
+//
+inline bool flatEmpty(const flattree &tree) {
+    return tree.nodes.empty() && !(tree.root & FLAT_LEAF);
+}
+
+//
+// *This function returns the symbol of a leaf entry.
+//
+inline int flatSymbol(uint16_t entry) {
+    return (int)(int16_t)(uint16_t)(entry << 1) >> 1;
+}
+
+//
+// *This function reads one symbol from input by walking nodes from entry,
+// the root's or a node's a table decoder has already reached.
+//
+inline int readSymbol(ibitbuffer &input, const flatnode* nodes,
+                      uint16_t entry) {
+    while (!(entry & FLAT_LEAF)) {
+        entry = nodes[entry].child[input.readBit()];
+    }
+    return flatSymbol(entry);
+}
+
+//
+// *This function reads one symbol from input with a flattened tree.
+//
+inline int readSymbol(ibitbuffer &input, const flattree &tree) {
+    return readSymbol(input, tree.nodes.data(), tree.root);
+}
@@ -25,8 +25,7 @@ hashmap::~hashmap() {
             front = temp;
         }
     }
-    delete[] buckets;
-    
+    trackedFree(MEMORY_HASHMAP, buckets, nBuckets * sizeof(key_val_pair*));
 }
 
 //
@@ -220,6 +219,10 @@ istream &operator>>(istream &in, hashmap &myMap) {
     while (!done) {
         string nextInput;
         while (nextChar != ',' and nextChar != '}') {
+                if (nextChar == EOF) {  // cut off: fail rather than loop
+                    in.setstate(ios::failbit);
+                    return in;
+                }
                 nextInput += nextChar;
                 nextChar = in.get();
         }
@@ -249,7 +252,8 @@ istream &operator>>(istream &in, hashmap &myMap) {
 // return an array of heads of linked lists of key_val_pairs
 //
 hashmap::bucketArray hashmap::createBucketArray(int nBuckets) {
-    bucketArray newBuckets = new key_val_pair*[nBuckets];
+    bucketArray newBuckets = (bucketArray)trackedAllocate(
+        MEMORY_HASHMAP, nBuckets * sizeof(key_val_pair*));
     for (int i = 0; i < nBuckets; i++) {
         newBuckets[i] = nullptr;
     }
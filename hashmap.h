@@ -3,6 +3,7 @@
 #include <vector>
 #include <ostream>
 #include <istream>
+#include "memory.h"
 using namespace std;
 
 class hashmap
@@ -31,6 +32,13 @@ private:
         int key;
         int value;
         key_val_pair* next;
+
+        static void* operator new(size_t size) {
+            return trackedAllocate(MEMORY_HASHMAP, size);
+        }
+        static void operator delete(void* p, size_t size) {
+            trackedFree(MEMORY_HASHMAP, p, size);
+        }
     };
 
     typedef key_val_pair** bucketArray; 
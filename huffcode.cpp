@@ -0,0 +1,102 @@
+#include <vector>
+#include <climits>
+#include <stdint.h>
+#include "huffcode.h"
+
+using namespace std;
+
+//
+// *This function builds a frequency map from an array of symbol counts,
+// skipping symbols that never occur.
+//
+void buildFrequencyMap(const vector<int> &counts, hashmapF &map) {
+    for (unsigned int i = 0; i < counts.size(); i++) {
+        if (counts[i] > 0) map.put(i, counts[i]);
+    }
+}
+
+//
+// *Helper for readFrequencyMap: reads a decimal int, with an optional minus
+// sign, into value.  Returns false at the end of input, on anything that is
+// not a number, or if it does not fit in an int.
+//
+bool _readTableNumber(istream &input, int &value) {
+    bool negative = input.peek() == '-';
+    if (negative) input.get();
+    long long v = 0;
+    int digits = 0;
+    while (input.peek() >= '0' && input.peek() <= '9') {
+        v = v * 10 + (input.get() - '0');
+        if (++digits > 10) return false;
+    }
+    if (digits == 0) return false;
+    if (negative) v = -v;
+    if (v < INT_MIN || v > INT_MAX) return false;
+    value = (int)v;
+    return true;
+}
+
+//
+// *This function reads a "{k:v, k:v}" table, as operator<< writes it, into
+// map.  It is for tables read from files: unlike operator>>, it fails,
+// rather than looping or throwing, at the end of the input, on anything
+// malformed, on a negative count, after alphabet pairs, and on a key
+// outside 0..alphabet - 1 or equal to NOT_A_CHAR, which would make a leaf
+// that looks like an internal node and send decoding off the tree.
+//
+bool readFrequencyMap(istream &input, hashmapF &map, int alphabet) {
+    if (input.get() != '{') return false;
+    if (input.peek() == '}') {
+        input.get();
+        return true;
+    }
+    for (int entries = 0; entries < alphabet; entries++) {
+        int key = 0, value = 0;
+        if (!_readTableNumber(input, key) || key < 0 || key >= alphabet ||
+            key == NOT_A_CHAR || input.get() != ':' ||
+            !_readTableNumber(input, value) || value < 0) {
+            return false;
+        }
+        map.put(key, value);
+        int next = input.get();
+        if (next == '}') return true;
+        if (next != ',' || input.get() != ' ') return false;
+    }
+    return false;
+}
+
+//
+// *This function builds an encoding tree the same way buildEncodingTree does,
+// except that an empty map gives an empty (nullptr) tree.
+//
+HuffmanNode* buildCodingTree(hashmapF &map) {
+    if (map.size() == 0) return nullptr;
+    return buildEncodingTree(map);
+}
+
+//
+// *Recursive helper function for building the code table.
+//
+void _buildCodeTable(HuffmanNode* node, vector<HuffmanCode> &table,
+                     uint64_t bits, int length) {
+    if (node == nullptr) return;
+    if (node->character != NOT_A_CHAR) {
+        table[node->character].bits = bits;
+        table[node->character].length = length;
+        return;
+    }
+    _buildCodeTable(node->zero, table, bits, length + 1);
+    _buildCodeTable(node->one, table, bits | ((uint64_t)1 << length),
+                    length + 1);
+}
+
+//
+// *This function builds a code table indexed by symbol from an encoding tree.
+// A tree that is a single leaf gives that symbol a zero-length code.
+//
+vector<HuffmanCode> buildCodeTable(HuffmanNode* tree, int alphabetSize) {
+    HuffmanCode none = {0, 0};
+    vector<HuffmanCode> table(alphabetSize, none);
+    _buildCodeTable(tree, table, 0, 0);
+    return table;
+}
@@ -0,0 +1,53 @@
+//
+// huffcode.h
+//
+// Helpers for coding integer symbols with the Huffman tree builder from
+// util.h.  Instead of the "0101" strings of buildEncodingMap, a code table
+// keeps each code as its bits plus a length so it can be written to an
+// obitbuffer in one call.  Symbols are non-negative ints below alphabetSize;
+// they must not be NOT_A_CHAR, which marks internal tree nodes.
+//
+#pragma once
+
+#include <istream>
+#include <vector>
+#include <stdint.h>
+#include "hashmap.h"
+#include "bitbuffer.h"
+#include "util.h"
+
+using namespace std;
+
+struct HuffmanCode {
+    uint64_t bits;  // first bit of the code in bit 0
+    int length;
+};
+
+const int TABLE_MAX_SYMBOLS = 65536;
+
+void buildFrequencyMap(const vector<int> &counts, hashmapF &map);
+bool _readTableNumber(istream &input, int &value);
+bool readFrequencyMap(istream &input, hashmapF &map,
+                      int alphabet = TABLE_MAX_SYMBOLS);
+HuffmanNode* buildCodingTree(hashmapF &map);
+void _buildCodeTable(HuffmanNode* node, vector<HuffmanCode> &table,
+                     uint64_t bits, int length);
+vector<HuffmanCode> buildCodeTable(HuffmanNode* tree, int alphabetSize);
+
+//
+// *This function writes the code for symbol to output.
+//
+inline void writeSymbol(obitbuffer &output, const vector<HuffmanCode> &table,
+                        int symbol) {
+    output.writeBits(table[symbol].bits, table[symbol].length);
+}
+
+//
+// *This function reads one symbol from input by walking the encoding tree.
+//
+inline int readSymbol(ibitbuffer &input, HuffmanNode* tree) {
+    while (tree->character == NOT_A_CHAR) {
+        tree = input.readBit() ? tree->one : tree->zero;
+    }
+    return tree->character;
+}
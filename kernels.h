@@ -0,0 +1,216 @@
+//
+// kernels.h
+//
+// The inner encode and decode loops of codec.h, specialized at compile time
+// for an alphabet size, a longest code and a lookup table width.  With those
+// fixed, the table size, masks and the number of codes that fit in one
+// 64-bit word are constants, so the compiler unrolls the per-word loops and
+// drops the tree fallback where no code is longer than the table.
+//
+// Both loops move 8 bytes at a time: the encoder adds codes to a 64-bit
+// accumulator and stores all of it, advancing by the whole bytes filled;
+// the decoder loads 8 bytes at its bit position and decodes as many codes as
+// are sure to be in them.  Near the ends of the buffers they fall back to a
+// byte at a time.
+//
+// The configurations in use are declared at the bottom and instantiated
+// once, in codec.cpp, where selectKernel picks one at run time from the
+// longest code.
+//
+#pragma once
+
+#include <cstring>
+#include <stdint.h>
+#include <type_traits>
+#include "bitbuffer.h"
+#include "huffcode.h"
+#include "flattree.h"
+#include "util.h"
+
+using namespace std;
+
+//
+// One decode lookup entry: the symbol a run of lookup bits starts with, or
+// the flattened tree node (flattree.h) a longer code continues from.  Four
+// bytes, so a 12-bit table fits in L1.
+//
+struct codecentry {
+    uint16_t value;        // the symbol, or the node's index in the tree
+    unsigned char length;  // bits the entry uses; 0 for no such code
+    unsigned char isNode;  // the code is longer and continues at a node
+};
+
+//
+// *This function loads 8 bytes as a little-endian word.
+//
+inline uint64_t loadLittle64(const uint8_t* p) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+//
+// *This function stores a word as 8 little-endian bytes.
+//
+inline void storeLittle64(uint8_t* p, uint64_t word) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    memcpy(p, &word, 8);
+}
+
+template <int Symbols, int MaxLength, int LookupBits>
+struct huffkernel {
+    typedef typename conditional<(Symbols <= 256), uint8_t, uint16_t>::type
+        symbol;
+
+    static constexpr int TABLE_SIZE = 1 << LookupBits;
+    static constexpr uint64_t LOOKUP_MASK = TABLE_SIZE - 1;
+    // codes per 64-bit word, leaving up to 7 bits of a partial byte
+    static constexpr int CODES_PER_WORD = 56 / MaxLength;
+    static constexpr bool LONG_CODES = MaxLength > LookupBits;
+
+    static_assert(Symbols <= 65536, "symbols must fit in 16 bits");
+    static_assert(LookupBits <= MaxLength && CODES_PER_WORD >= 1,
+                  "bad code length limits");
+
+    //
+    // *This function fills lookup (TABLE_SIZE entries) from the flattened
+    // decode tree, whose root is nodes[0].
+    //
+    static void buildLookup(const flatnode* nodes, codecentry* lookup) {
+        for (int i = 0; i < TABLE_SIZE; i++) {
+            codecentry &entry = lookup[i];
+            entry.value = 0;
+            entry.length = 0;
+            entry.isNode = 0;
+            uint16_t node = 0;
+            int b = 0;
+            while (!(node & FLAT_LEAF) && b < LookupBits) {
+                node = nodes[node].child[(i >> b) & 1];
+                b++;
+                if (node == 0) break;
+            }
+            if (node == 0) continue;
+            if (!(node & FLAT_LEAF)) {
+                entry.value = node;
+                entry.isNode = 1;
+            } else {
+                entry.value = (uint16_t)flatSymbol(node);
+            }
+            entry.length = (unsigned char)b;
+        }
+    }
+
+    //
+    // *This function writes the codes for n symbols to dst, which must have
+    // room for all of them and ends at end.  Returns the bytes written.
+    //
+    static size_t encode(const symbol* in, size_t n, const HuffmanCode* codes,
+                         uint8_t* dst, uint8_t* end) {
+        uint8_t* start = dst;
+        uint64_t acc = 0;
+        int nbits = 0;
+        size_t i = 0;
+        while (i + CODES_PER_WORD <= n && end - dst >= 8) {
+            for (int k = 0; k < CODES_PER_WORD; k++) {
+                const HuffmanCode &code = codes[in[i + k]];
+                acc |= code.bits << nbits;
+                nbits += code.length;
+            }
+            i += CODES_PER_WORD;
+            storeLittle64(dst, acc);
+            dst += nbits >> 3;
+            acc >>= nbits & ~7;
+            nbits &= 7;
+        }
+        for (; i < n; i++) {
+            const HuffmanCode &code = codes[in[i]];
+            acc |= code.bits << nbits;
+            nbits += code.length;
+            while (nbits >= 8) {
+                *dst++ = (uint8_t)acc;
+                acc >>= 8;
+                nbits -= 8;
+            }
+        }
+        if (nbits > 0) *dst++ = (uint8_t)acc;
+        return (size_t)(dst - start);
+    }
+
+    //
+    // *This function decodes count symbols from size bytes of data into out.
+    // Returns false if the data is corrupt or too short.
+    //
+    static bool decode(const uint8_t* data, size_t size,
+                       const codecentry* lookup, const flatnode* nodes,
+                       symbol* out, size_t count) {
+        const uint8_t* p = data;
+        const uint8_t* end = data + size;
+        int bitpos = 0;  // bits of *p already used
+        size_t i = 0;
+        while (i + CODES_PER_WORD <= count && end - p >= 8) {
+            uint64_t acc = loadLittle64(p) >> bitpos;
+            for (int k = 0; k < CODES_PER_WORD; k++) {
+                const codecentry &entry = lookup[acc & LOOKUP_MASK];
+                if (entry.length == 0) return false;
+                acc >>= entry.length;
+                bitpos += entry.length;
+                if (!LONG_CODES || !entry.isNode) {
+                    out[i + k] = (symbol)entry.value;
+                    continue;
+                }
+                uint16_t node = entry.value;
+                while (!(node & FLAT_LEAF)) {
+                    node = nodes[node].child[acc & 1];
+                    acc >>= 1;
+                    bitpos++;
+                }
+                out[i + k] = (symbol)flatSymbol(node);
+            }
+            i += CODES_PER_WORD;
+            p += bitpos >> 3;
+            bitpos &= 7;
+        }
+
+        ibitbuffer bits(p, (size_t)(end - p));
+        bits.peekBits(bitpos);
+        bits.skipBits(bitpos);
+        for (; i < count; i++) {
+            const codecentry &entry = lookup[bits.peekBits(LookupBits)];
+            if (entry.length == 0) return false;
+            bits.skipBits(entry.length);
+            if (!LONG_CODES || !entry.isNode) {
+                out[i] = (symbol)entry.value;
+            } else {
+                out[i] = (symbol)readSymbol(bits, nodes, entry.value);
+            }
+        }
+        return !bits.overrun();
+    }
+};
+
+extern template struct huffkernel<256, 11, 11>;
+extern template struct huffkernel<256, 12, 12>;
+extern template struct huffkernel<256, 15, 12>;
+
+//
+// A byte kernel chosen at run time.
+//
+struct bytekernel {
+    int maxLength;
+    int lookupBits;
+    void (*buildLookup)(const flatnode*, codecentry*);
+    size_t (*encode)(const uint8_t*, size_t, const HuffmanCode*, uint8_t*,
+                     uint8_t*);
+    bool (*decode)(const uint8_t*, size_t, const codecentry*,
+                   const flatnode*, uint8_t*, size_t);
+};
+
+extern const bytekernel BYTE_KERNELS[];
+const int KERNEL_MAX_LOOKUP_BITS = 12;
+
+int selectKernel(int longest);
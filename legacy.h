@@ -0,0 +1,297 @@
+//
+// legacy.h
+//
+// Converts files written by compress (a "{k:v, ...}" frequency map followed
+// by the bitstream, ending in PSEUDO_EOF) to the block format, in place.
+//
+// Converting a large collection is dominated by decoding, so nothing here
+// goes through operator>> or walks the tree a bit at a time:
+//      - the header is parsed straight from the first chunk of the file;
+//      - the bitstream is decoded a byte at a time with a table built from
+//        the tree: for each internal node and each input byte, the bytes
+//        that come out and the node the walk ends on;
+//      - the file is read and re-encoded in chunks, so memory stays bounded
+//        by the chunk and block sizes, not the file size.
+// A directory is converted with one file per worker thread.
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "hashmap.h"
+#include "block.h"
+#include "parallel.h"
+#include "util.h"
+
+using namespace std;
+
+const size_t LEGACY_CHUNK_SIZE = 1024 * 1024;
+
+//
+// *This function parses a legacy header "{k:v, k:v}" at the start of data,
+// putting the pairs into map in file order, as operator>> would, so the tree
+// built from it is the one the file was written with.  Keys must be chars
+// (signed or not) or PSEUDO_EOF and counts positive; anything else would
+// build a tree the decoder cannot walk.  Returns the number of bytes the
+// header takes, or 0 if it is malformed.
+//
+inline size_t parseLegacyHeader(const unsigned char* data, size_t n,
+                                hashmapF &map) {
+    size_t i = 0;
+    if (n == 0 || data[i++] != '{') return 0;
+    if (i < n && data[i] == '}') return i + 1;
+    while (i < n) {
+        long pair[2] = {0, 0};
+        for (int k = 0; k < 2; k++) {
+            bool negative = i < n && data[i] == '-';
+            if (negative) i++;
+            size_t digits = i;
+            while (i < n && data[i] >= '0' && data[i] <= '9') {
+                pair[k] = pair[k] * 10 + (data[i++] - '0');
+                if (pair[k] > 0x7fffffff) return 0;
+            }
+            if (i == digits || i >= n) return 0;
+            if (negative) pair[k] = -pair[k];
+            if (k == 0 && data[i++] != ':') return 0;
+        }
+        bool key = (pair[0] >= -128 && pair[0] <= 255) ||
+                   pair[0] == PSEUDO_EOF;
+        if (!key || pair[1] <= 0) return 0;
+        map.put((int)pair[0], (int)pair[1]);
+        if (data[i] == '}') return i + 1;
+        if (data[i] != ',' || i + 1 >= n || data[i + 1] != ' ') return 0;
+        i += 2;
+    }
+    return 0;
+}
+
+//
+// One step of the byte-at-a-time decoder: what reading one input byte from
+// an internal node produces.
+//
+struct legacystep {
+    unsigned short next;  // internal node the walk ends on
+    unsigned char count;  // bytes decoded
+    bool eof;             // PSEUDO_EOF was reached after those bytes
+    unsigned char out[8];
+};
+
+//
+// A streaming decoder for the legacy bitstream.  Bits are read from each
+// byte lowest first, as ofbitstream writes them.
+//
+class legacydecoder {
+public:
+    //
+    // *This constructor builds the step table from an encoding tree.
+    //
+    legacydecoder(HuffmanNode* tree) : state(0), finished(false),
+                                       corrupt(false) {
+        if (tree == nullptr || tree->character != NOT_A_CHAR) {
+            // a single leaf: an empty file, or no PSEUDO_EOF to stop at
+            finished = tree != nullptr && tree->character == PSEUDO_EOF;
+            corrupt = !finished;
+            return;
+        }
+        unordered_map<HuffmanNode*, int> index;
+        vector<HuffmanNode*> nodes(1, tree);
+        index[tree] = 0;
+        for (unsigned int i = 0; i < nodes.size(); i++) {
+            HuffmanNode* children[2] = {nodes[i]->zero, nodes[i]->one};
+            for (int c = 0; c < 2; c++) {
+                if (children[c] == nullptr) {
+                    corrupt = true;
+                    return;
+                }
+                if (children[c]->character != NOT_A_CHAR) continue;
+                index[children[c]] = (int)nodes.size();
+                nodes.push_back(children[c]);
+            }
+        }
+        steps.resize(nodes.size() * 256);
+        for (unsigned int i = 0; i < nodes.size(); i++) {
+            for (int b = 0; b < 256; b++) {
+                legacystep &step = steps[i * 256 + b];
+                step.count = 0;
+                step.eof = false;
+                HuffmanNode* node = nodes[i];
+                for (int k = 0; k < 8 && !step.eof; k++) {
+                    node = ((b >> k) & 1) ? node->one : node->zero;
+                    if (node->character == NOT_A_CHAR) continue;
+                    if (node->character == PSEUDO_EOF) {
+                        step.eof = true;
+                    } else {
+                        step.out[step.count++] = (unsigned char)node->character;
+                    }
+                    node = tree;
+                }
+                step.next = (unsigned short)index[node];
+            }
+        }
+    }
+
+    //
+    // *This function decodes n bytes of the bitstream, appending the result
+    // to out.  Input after PSEUDO_EOF is ignored.
+    //
+    void decode(const unsigned char* data, size_t n,
+                vector<unsigned char> &out) {
+        const legacystep* table = steps.data();
+        for (size_t i = 0; i < n && !finished; i++) {
+            const legacystep &step = table[state * 256 + data[i]];
+            out.insert(out.end(), step.out, step.out + step.count);
+            state = step.next;
+            finished = step.eof;
+        }
+    }
+
+    bool done() { return finished; }
+    bool failed() { return corrupt; }
+
+private:
+    vector<legacystep> steps;
+    int state;
+    bool finished;  // PSEUDO_EOF has been decoded
+    bool corrupt;
+};
+
+//
+// *This function converts one legacy file to a block file of the same name.
+// The block file is written next to it and renamed over it only once the
+// whole bitstream decoded, so a corrupt file is left as it was.  rawSize and
+// compressedSize are set to the decoded and new sizes.  Returns false if the
+// file is not a legacy file or is corrupt.
+//
+inline bool convertLegacyFile(string filename, int blockSize, size_t &rawSize,
+                              size_t &compressedSize) {
+    rawSize = compressedSize = 0;
+    if (blockSize < 1) blockSize = BLOCK_DEFAULT_SIZE;
+    blockSize = min(blockSize, BLOCK_MAX_SIZE);
+    ifstream input(filename, ios::binary);
+    vector<unsigned char> chunk(LEGACY_CHUNK_SIZE);
+    input.read((char*)chunk.data(), chunk.size());
+    size_t n = (size_t)input.gcount();
+    hashmapF frequencyMap;
+    size_t headerSize = parseLegacyHeader(chunk.data(), n, frequencyMap);
+    if (headerSize == 0 || frequencyMap.size() == 0) return false;
+    HuffmanNode* tree = buildEncodingTree(frequencyMap);
+    legacydecoder decoder(tree);
+    freeTree(tree);
+    if (decoder.failed()) return false;
+
+    string tempname = filename + ".tmp";
+    ofstream output(tempname, ios::binary);
+    output << HEADER_TAG << BLOCK_MODE << blockSize << '\n';
+    vector<blockindexentry> index;
+    vector<unsigned char> pending;
+    huffblock block;
+    blocktable previous = {0, hashmapF()};
+    size_t start = headerSize;
+    while (true) {
+        decoder.decode(chunk.data() + start, n - start, pending);
+        bool last = decoder.done() || !input;
+        size_t used = 0;
+        while (pending.size() - used >= (size_t)blockSize ||
+               (last && used < pending.size())) {
+            size_t size = min(pending.size() - used, (size_t)blockSize);
+            blockindexentry entry = {rawSize, (size_t)output.tellp()};
+            index.push_back(entry);
+            encodeBlock(pending.data() + used, size, block, &previous);
+            writeBlock(output, block);
+            resolveTable(block, previous);
+            used += size;
+            rawSize += size;
+        }
+        pending.erase(pending.begin(), pending.begin() + used);
+        if (last) break;
+        input.read((char*)chunk.data(), chunk.size());
+        n = (size_t)input.gcount();
+        start = 0;
+    }
+    writeBlockIndex(output, index, rawSize, 0);
+    compressedSize = (size_t)output.tellp();
+    output.close();
+    if (!decoder.done() || rename(tempname.c_str(), filename.c_str()) != 0) {
+        remove(tempname.c_str());
+        return false;
+    }
+    return true;
+}
+
+//
+// *This function adds the legacy files under path to files: path itself if
+// it is a file, or every ".huf" file in it and its subdirectories that starts
+// with a legacy header.
+//
+inline void findLegacyFiles(string path, vector<string> &files) {
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        files.push_back(path);
+        return;
+    }
+    while (dirent* entry = readdir(dir)) {
+        string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        string child = path + "/" + name;
+        struct stat info;
+        if (stat(child.c_str(), &info) != 0) continue;
+        if (S_ISDIR(info.st_mode)) {
+            findLegacyFiles(child, files);
+        } else if (name.length() > 4 &&
+                   name.compare(name.length() - 4, 4, ".huf") == 0) {
+            ifstream input(child, ios::binary);
+            if (input.get() == '{') files.push_back(child);
+        }
+    }
+    closedir(dir);
+}
+
+//
+// *This function converts the legacy files in paths (files or directories)
+// in parallel and prints the totals and throughput.  Returns false if any
+// file failed to convert.
+//
+inline bool convertLegacy(const vector<string> &paths, int blockSize) {
+    vector<string> files;
+    for (unsigned int i = 0; i < paths.size(); i++) {
+        findLegacyFiles(paths[i], files);
+    }
+    int count = (int)files.size();
+    vector<size_t> rawSizes(count), compressedSizes(count);
+    vector<char> ok(count, 0);
+    auto start = chrono::steady_clock::now();
+    parallelFor(count, [&](int i) {
+        ok[i] = convertLegacyFile(files[i], blockSize, rawSizes[i],
+                                  compressedSizes[i]);
+    });
+    double seconds = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+
+    size_t rawTotal = 0, compressedTotal = 0;
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (!ok[i]) {
+            cout << "Not converted (not a legacy file or corrupt): "
+                 << files[i] << endl;
+            failed++;
+            continue;
+        }
+        rawTotal += rawSizes[i];
+        compressedTotal += compressedSizes[i];
+    }
+    cout << "Converted " << count - failed << " of " << count << " files, "
+         << rawTotal << " bytes decoded, " << compressedTotal
+         << " bytes written in " << seconds << " s";
+    if (seconds > 0) {
+        cout << " (" << rawTotal / seconds / (1024 * 1024) << " MB/s)";
+    }
+    cout << endl;
+    return failed == 0;
+}
@@ -0,0 +1,396 @@
+//
+// lz77.h
+//
+// An optional LZ77 front-end for the Huffman coder.  The input is parsed
+// into literals and (length, distance) matches with a hash-chain match
+// finder, and the tokens are Huffman coded with two trees built by
+// buildEncodingTree:
+//      literal/length alphabet:  0-255 literal bytes, PSEUDO_EOF, then the
+//                                length codes from LZ_LENGTH_BASE
+//      distance alphabet:        distance codes from 0
+// Lengths and distances are coded as a code symbol plus extra bits, using
+// buckets of one bit of precision below the leading bit (as in deflate, but
+// computed so that any window size up to 2^LZ_MAX_WINDOW_BITS works).
+//
+// Stream layout (what lzCompressBuffer writes):
+//      {literal/length map}{distance map}<payload bytes>\n<payload>
+// File layout (what lzCompress writes):
+//      #L<uncompressed size>\n<stream>
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include "hashmap.h"
+#include "bitbuffer.h"
+#include "huffcode.h"
+#include "util.h"
+
+using namespace std;
+
+const char LZ_MODE = 'L';
+const size_t LZ_MEMORY_COST = 3;  // bytes held per byte of input
+
+const int LZ_MIN_MATCH = 3;
+const int LZ_MAX_MATCH = 258;
+const int LZ_MIN_WINDOW_BITS = 10;
+const int LZ_MAX_WINDOW_BITS = 22;
+const int LZ_HASH_BITS = 15;
+
+// length symbols skip NOT_A_CHAR, which the tree uses for internal nodes
+const int LZ_LENGTH_BASE = NOT_A_CHAR + 1;
+const int LZ_LENGTH_CODES = 16;
+const int LZ_LITLEN_SYMBOLS = LZ_LENGTH_BASE + LZ_LENGTH_CODES;
+const int LZ_DISTANCE_SYMBOLS = 2 * LZ_MAX_WINDOW_BITS;
+
+struct lzconfig {
+    int windowBits;  // window is 2^windowBits bytes
+    int level;       // 0 (literals only) to 9 (longest search)
+};
+
+const lzconfig LZ_DEFAULT_CONFIG = {15, 6};
+
+struct lztoken {
+    unsigned int distance;  // 0 for a literal
+    unsigned short length;  // match length, or the literal byte
+};
+
+//
+// *This function splits a value into a bucket code and extra bits.  Values
+// below 4 are their own code; larger values keep their leading bit and the
+// bit below it in the code and the rest as extra bits.
+//
+inline int lzValueCode(unsigned int value, int &extraBits,
+                              unsigned int &extra) {
+    if (value < 4) {
+        extraBits = 0;
+        extra = 0;
+        return value;
+    }
+    int nb = 31 - __builtin_clz(value);
+    extraBits = nb - 1;
+    extra = value & ((1u << extraBits) - 1);
+    return 2 * nb + ((value >> extraBits) & 1);
+}
+
+//
+// *This function is the inverse of lzValueCode.
+//
+inline unsigned int lzValueBase(int code, int &extraBits) {
+    if (code < 4) {
+        extraBits = 0;
+        return code;
+    }
+    int nb = code / 2;
+    extraBits = nb - 1;
+    return (2u | (code & 1)) << extraBits;
+}
+
+//
+// Hash-chain match finder.  head holds the most recent position for each
+// hash of three bytes, and prev links every position in the window to the
+// previous position with the same hash.
+//
+class lzmatcher {
+public:
+    lzmatcher(const vector<unsigned char> &in, lzconfig config)
+        : in(in), window(1u << config.windowBits), mask(window - 1),
+          head(1 << LZ_HASH_BITS, -1), prev(window, -1), nextInsert(0) {
+        static const int chains[] = {0, 4, 8, 16, 32, 64, 128, 256, 1024,
+                                     4096};
+        static const int nice[] = {0, 8, 16, 32, 64, 128, 128, 258, 258,
+                                   258};
+        int level = config.level < 0 ? 0 : (config.level > 9 ? 9 :
+                                                               config.level);
+        maxChain = chains[level];
+        niceLength = nice[level];
+        lazy = level >= 4;
+    }
+
+    //
+    // Finds the longest match for pos within the window.  Returns its length
+    // (0 if shorter than LZ_MIN_MATCH) and sets distance.
+    //
+    int findMatch(size_t pos, unsigned int &distance) {
+        insertUpTo(pos);
+        size_t n = in.size();
+        int maxLength = (int)min((size_t)LZ_MAX_MATCH, n - pos);
+        if (maxChain == 0 || maxLength < LZ_MIN_MATCH) return 0;
+
+        const unsigned char* cur = &in[pos];
+        int bestLength = LZ_MIN_MATCH - 1;
+        int candidate = head[hash(pos)];
+        int chain = maxChain;
+        // after a lazy look-ahead pos itself may already be in the chain
+        if (candidate >= 0 && (size_t)candidate == pos) {
+            candidate = prev[candidate & mask];
+        }
+        while (candidate >= 0 && pos - candidate <= window && chain-- > 0) {
+            const unsigned char* match = &in[candidate];
+            if (match[bestLength] == cur[bestLength] && match[0] == cur[0]) {
+                int length = 1;
+                while (length < maxLength && match[length] == cur[length]) {
+                    length++;
+                }
+                if (length > bestLength) {
+                    bestLength = length;
+                    distance = (unsigned int)(pos - candidate);
+                    // nothing is longer, and probing match[bestLength]
+                    // would read past the input
+                    if (length >= niceLength || length == maxLength) break;
+                }
+            }
+            candidate = prev[candidate & mask];
+        }
+        return bestLength >= LZ_MIN_MATCH ? bestLength : 0;
+    }
+
+    int maxChain;
+    int niceLength;
+    bool lazy;
+
+private:
+    unsigned int hash(size_t pos) const {
+        unsigned int v = (in[pos] << 16) | (in[pos + 1] << 8) | in[pos + 2];
+        return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+    }
+
+    // adds every position before pos to the hash chains
+    void insertUpTo(size_t pos) {
+        size_t n = in.size();
+        for (; nextInsert < pos; nextInsert++) {
+            if (nextInsert + LZ_MIN_MATCH > n) continue;
+            unsigned int h = hash(nextInsert);
+            prev[nextInsert & mask] = head[h];
+            head[h] = (int)nextInsert;
+        }
+    }
+
+    const vector<unsigned char> &in;
+    size_t window;
+    size_t mask;
+    vector<int> head;
+    vector<int> prev;
+    size_t nextInsert;
+};
+
+//
+// *This function parses in into LZ77 tokens.  With lazy matching, a match is
+// deferred by one byte when the next position has a longer one.
+//
+inline void lzParse(const vector<unsigned char> &in, lzconfig config,
+                    vector<lztoken> &tokens) {
+    lzmatcher matcher(in, config);
+    size_t pos = 0;
+    while (pos < in.size()) {
+        unsigned int distance = 0;
+        int length = matcher.findMatch(pos, distance);
+        if (length > 0 && matcher.lazy && length < matcher.niceLength &&
+            pos + 1 < in.size()) {
+            unsigned int nextDistance = 0;
+            if (matcher.findMatch(pos + 1, nextDistance) > length) {
+                length = 0;
+            }
+        }
+        lztoken token;
+        if (length > 0) {
+            token.distance = distance;
+            token.length = (unsigned short)length;
+            pos += length;
+        } else {
+            token.distance = 0;
+            token.length = in[pos];
+            pos++;
+        }
+        tokens.push_back(token);
+    }
+}
+
+//
+// *This function LZ77 parses in and writes the Huffman coded token stream to
+// output.
+//
+inline void lzCompressBuffer(const vector<unsigned char> &in, lzconfig config,
+                             ostream &output) {
+    vector<lztoken> tokens;
+    lzParse(in, config, tokens);
+
+    // count literal/length and distance symbols
+    vector<int> litlenCounts(LZ_LITLEN_SYMBOLS, 0);
+    vector<int> distanceCounts(LZ_DISTANCE_SYMBOLS, 0);
+    int extraBits;
+    unsigned int extra;
+    for (unsigned int i = 0; i < tokens.size(); i++) {
+        if (tokens[i].distance == 0) {
+            litlenCounts[tokens[i].length]++;
+        } else {
+            litlenCounts[LZ_LENGTH_BASE + lzValueCode(
+                tokens[i].length - LZ_MIN_MATCH, extraBits, extra)]++;
+            distanceCounts[lzValueCode(tokens[i].distance - 1, extraBits,
+                                       extra)]++;
+        }
+    }
+    litlenCounts[PSEUDO_EOF] = 1;
+
+    hashmapF litlenMap, distanceMap;
+    buildFrequencyMap(litlenCounts, litlenMap);
+    buildFrequencyMap(distanceCounts, distanceMap);
+    HuffmanNode* litlenTree = buildCodingTree(litlenMap);
+    HuffmanNode* distanceTree = buildCodingTree(distanceMap);
+    vector<HuffmanCode> litlenCodes = buildCodeTable(litlenTree,
+                                                     LZ_LITLEN_SYMBOLS);
+    vector<HuffmanCode> distanceCodes = buildCodeTable(distanceTree,
+                                                       LZ_DISTANCE_SYMBOLS);
+
+    obitbuffer bits;
+    for (unsigned int i = 0; i < tokens.size(); i++) {
+        if (tokens[i].distance == 0) {
+            writeSymbol(bits, litlenCodes, tokens[i].length);
+            continue;
+        }
+        int code = lzValueCode(tokens[i].length - LZ_MIN_MATCH, extraBits,
+                               extra);
+        writeSymbol(bits, litlenCodes, LZ_LENGTH_BASE + code);
+        bits.writeBits(extra, extraBits);
+        code = lzValueCode(tokens[i].distance - 1, extraBits, extra);
+        writeSymbol(bits, distanceCodes, code);
+        bits.writeBits(extra, extraBits);
+    }
+    writeSymbol(bits, litlenCodes, PSEUDO_EOF);
+
+    vector<unsigned char> &payload = bits.bytes();
+    output << litlenMap << distanceMap << payload.size() << '\n';
+    writeBytes(output, payload.data(), payload.size());
+    freeTree(litlenTree);
+    freeTree(distanceTree);
+}
+
+//
+// *This function decodes a token stream written by lzCompressBuffer and
+// appends the rawSize bytes it holds to out.  Returns false if the stream
+// is corrupt.  Every code is at least a bit and a match at most
+// LZ_MAX_MATCH bytes, so a rawSize the payload cannot hold is rejected
+// before anything is allocated.
+//
+inline bool lzDecompressBuffer(istream &input, size_t rawSize,
+                               vector<unsigned char> &out) {
+    hashmapF litlenMap, distanceMap;
+    size_t payloadSize = 0;
+    if (!readFrequencyMap(input, litlenMap, LZ_LITLEN_SYMBOLS) ||
+        !readFrequencyMap(input, distanceMap, LZ_DISTANCE_SYMBOLS) ||
+        !(input >> payloadSize) || input.get() != '\n' ||
+        payloadSize > bytesLeft(input) ||
+        rawSize / LZ_MAX_MATCH / 8 > payloadSize) {
+        return false;
+    }
+    vector<unsigned char> payload(payloadSize);
+    if (payloadSize > 0) input.read((char*)&payload[0], payloadSize);
+    if (!input) return false;
+
+    HuffmanNode* litlenTree = buildCodingTree(litlenMap);
+    HuffmanNode* distanceTree = buildCodingTree(distanceMap);
+    if (litlenTree == nullptr) {
+        freeTree(distanceTree);
+        return false;
+    }
+
+    size_t start = out.size();
+    out.resize(start + rawSize);
+    unsigned char* dst = out.empty() ? nullptr : &out[start];
+    size_t op = 0;
+    ibitbuffer bits(payload.data(), payload.size());
+    bool ok = true;
+    while (true) {
+        int symbol = readSymbol(bits, litlenTree);
+        if (symbol < PSEUDO_EOF) {
+            if (op >= rawSize) { ok = false; break; }
+            dst[op++] = (unsigned char)symbol;
+            continue;
+        }
+        if (symbol == PSEUDO_EOF) break;
+        // the tables are checked against the alphabets, but the base tables
+        // are only defined for these codes
+        int lengthCode = symbol - LZ_LENGTH_BASE;
+        if (lengthCode < 0 || lengthCode >= LZ_LENGTH_CODES ||
+            distanceTree == nullptr) {
+            ok = false;
+            break;
+        }
+        int extraBits;
+        size_t length = LZ_MIN_MATCH + lzValueBase(lengthCode, extraBits);
+        length += bits.readBits(extraBits);
+        int distanceCode = readSymbol(bits, distanceTree);
+        if (distanceCode < 0 || distanceCode >= LZ_DISTANCE_SYMBOLS) {
+            ok = false;
+            break;
+        }
+        size_t distance = 1 + lzValueBase(distanceCode, extraBits);
+        distance += bits.readBits(extraBits);
+        if (distance > op || length > rawSize - op || bits.overrun()) {
+            ok = false;
+            break;
+        }
+        // tight copy loop; overlapping matches copy byte by byte so that
+        // runs repeat the way the encoder saw them
+        unsigned char* to = dst + op;
+        const unsigned char* from = to - distance;
+        if (distance >= length) {
+            memcpy(to, from, length);
+        } else {
+            for (size_t i = 0; i < length; i++) to[i] = from[i];
+        }
+        op += length;
+    }
+    freeTree(litlenTree);
+    freeTree(distanceTree);
+    return ok && op == rawSize && !bits.overrun();
+}
+
+//
+// *This function compresses filename into (filename + ".huf") with the LZ77
+// front-end.  Returns the compressed size in bytes, or -1 on error.
+//
+inline long lzCompress(string filename, lzconfig config) {
+    vector<unsigned char> in;
+    if (!readFileBytes(filename, in)) return -1;
+    if (config.windowBits < LZ_MIN_WINDOW_BITS) {
+        config.windowBits = LZ_MIN_WINDOW_BITS;
+    }
+    if (config.windowBits > LZ_MAX_WINDOW_BITS) {
+        config.windowBits = LZ_MAX_WINDOW_BITS;
+    }
+    ofstream output(filename + ".huf", ios::binary);
+    output << HEADER_TAG << LZ_MODE << in.size() << '\n';
+    lzCompressBuffer(in, config, output);
+    long size = (long)output.tellp();
+    output.close();
+    return size;
+}
+
+//
+// *This function decompresses a file written by lzCompress.  The output is
+// named the same way decompress names it.  Returns false if the file is
+// corrupt.
+//
+inline bool lzDecompress(string filename) {
+    ifstream input(filename.substr(0, filename.find(".huf")) + ".huf",
+                   ios::binary);
+    size_t rawSize = 0;
+    if (input.get() != HEADER_TAG || input.get() != LZ_MODE ||
+        !(input >> rawSize) || input.get() != '\n') {
+        cout << "Not an LZ77 file." << endl;
+        return false;
+    }
+    vector<unsigned char> out;
+    if (!lzDecompressBuffer(input, rawSize, out)) {
+        cout << "Corrupt LZ77 data." << endl;
+        return false;
+    }
+    ofstream output(uncompressedFilename(filename), ios::binary);
+    writeBytes(output, out.data(), out.size());
+    output.close();
+    return true;
+}
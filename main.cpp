@@ -10,11 +10,29 @@
 #include <queue>
 #include <vector>
 #include <functional>
+#include <limits>
+#include <stdexcept>
+#include <climits>
 #include <ctype.h>
 #include <math.h>
 #include "hashmap.h"
 #include "bitstream.h"
 #include "util.h"
+#include "dictionary.h"
+#include "lz77.h"
+#include "bwt.h"
+#include "block.h"
+#include "tokens.h"
+#include "archive.h"
+#include "legacy.h"
+#include "daemon.h"
+#include "cache.h"
+#include "dedup.h"
+#include "codec.h"
+#include "flattree.h"
+#include "profile.h"
+#include "estimate.h"
+#include "sample.h"
 
 using namespace std;
 
@@ -29,10 +47,21 @@ string printChar(int val);
 void printMap(hashmapE &map);
 void printMap(hashmapF &map);
 void printTree(HuffmanNode* node, string str);
+void printTree(const flattree &tree, uint16_t entry, int count, string str);
 void printTextFile(string filename);
 void printBinaryFile(string filename);
+int runCommand(vector<string> args);
+void printUsage();
+bool parseNumber(string flag, string text, size_t low, size_t high,
+                 size_t &value);
+bool parsePercent(string flag, string text, double &value);
+
+int main(int argc, char* argv[]) {
+    // command line mode: program.exe <command> [options] <files...>
+    if (argc > 1) {
+        return runCommand(vector<string>(argv + 1, argv + argc));
+    }
 
-int main() {
     
     hashmapF frequencyMap;
     HuffmanNode* encodingTree = nullptr;
@@ -143,11 +172,18 @@ void do123456(string choice, string &filename, bool &isFile,
         encodingTree = buildEncodingTree(frequencyMap);
         cout << endl;
         cout << "Building encoding tree..." << endl;
-        printTree(encodingTree, "");
+        flattree flat;
+        if (flattenTree(encodingTree, flat)) {
+            printTree(flat, flat.root, flat.rootCount, "");
+        } else {
+            printTree(encodingTree, "");
+        }
         cout << endl;
     // Build Encoding Map
     } else if (choice == "3") {
-        encodingMap = buildEncodingMap(encodingTree);
+        flattree flat;
+        encodingMap = flattenTree(encodingTree, flat) ?
+                      buildEncodingMap(flat) : buildEncodingMap(encodingTree);
         cout << endl;
         cout << "Building encoding map..." << endl;
         printMap(encodingMap);
@@ -290,6 +326,24 @@ void printTree(HuffmanNode* node, string str) {
     }
 }
 
+//
+// printTree
+// Prints a flattened tree from entry, whose count is count, the same way.
+//
+void printTree(const flattree &tree, uint16_t entry, int count, string str) {
+    int character = (entry & FLAT_LEAF) ? flatSymbol(entry) : NOT_A_CHAR;
+    cout << str << "{" << printChar(character);
+    if (character != NOT_A_CHAR) cout << "(" << character << ")";
+    cout << ", count=" << count << "}" << endl;
+    if (entry & FLAT_LEAF) return;
+    for (int b = 0; b < 2; b++) {
+        uint16_t child = tree.nodes[entry].child[b];
+        if (child != 0) {
+            printTree(tree, child, tree.counts[2 * entry + b], str+" ");
+        }
+    }
+}
+
 //
 // printTextFile
 //
@@ -333,3 +387,398 @@ void printBinaryFile(string filename) {
     }
     cout << endl;
 }
+
+//
+// printUsage
+// Prints the command line usage to the screen.
+//
+void printUsage() {
+    cout << "usage: program.exe (no arguments starts the menu)" << endl;
+    cout << "       program.exe train <dict> <id> <corpus files...>" << endl;
+    cout << "       program.exe compress [--dict <dict>] <file>" << endl;
+    cout << "       program.exe compress --lz [--window <bits>] "
+         << "[--level <0-9>] <file>" << endl;
+    cout << "       program.exe compress --bwt [--block <KB>] <file>" << endl;
+    cout << "       program.exe compress --blocks [--append] [--block <KB>] "
+         << "<file>" << endl;
+    cout << "       program.exe compress --tokens <file>" << endl;
+    cout << "       program.exe compress --sampled <percent> <file>" << endl;
+    cout << "       program.exe compress --cache <dir> [options] <files...>"
+         << endl;
+    cout << "       program.exe compress --dedup <store> <files...>" << endl;
+    cout << "       program.exe decompress [--dict <dict>] <file.huf>"
+         << endl;
+    cout << "       program.exe decompress [--verify] "
+         << "[--range <offset>:<length>] <file.huf>" << endl;
+    cout << "       program.exe archive <archive> <files...>" << endl;
+    cout << "       program.exe extract <archive> [member]" << endl;
+    cout << "       program.exe list <archive>" << endl;
+    cout << "       program.exe estimate [--sample <KB>] <files...>" << endl;
+    cout << "       program.exe profile <file>" << endl;
+    cout << "       program.exe convert [--block <KB>] <files or dirs...>"
+         << endl;
+    cout << "       program.exe serve [--dict <dict>]... <socket>" << endl;
+    cout << "       program.exe client <socket> stats" << endl;
+    cout << "       program.exe loadgen [--dict <dict>] [--requests <n>] "
+         << "[--threads <n>]" << endl;
+    cout << "               [--size <bytes>] <socket> <file>" << endl;
+    cout << "any command also takes [--memory] [--max-memory <MB>]" << endl;
+}
+
+//
+// parseNumber
+// Parses text, the value given for flag, as a whole number from low to
+// high.  Otherwise prints what is wrong and the usage, and returns false.
+//
+bool parseNumber(string flag, string text, size_t low, size_t high,
+                 size_t &value) {
+    unsigned long long number = 0;
+    size_t used = 0;
+    try {
+        number = stoull(text, &used);
+    } catch (const logic_error &) {
+        used = 0;  // not a number, or past unsigned long long
+    }
+    // stoull skips spaces and takes a sign, so "-1" would come back huge
+    if (used == 0 || used != text.length() || !isdigit(text[0]) ||
+        number < low || number > high) {
+        cout << "Bad value for " << flag << ": \"" << text << "\" (a whole "
+             << "number from " << low << " to " << high << ")" << endl;
+        printUsage();
+        return false;
+    }
+    value = (size_t)number;
+    return true;
+}
+
+//
+// parsePercent
+// Parses text, the value given for flag, as a percentage above 0 and at
+// most 100.  Otherwise prints what is wrong and the usage, and returns false.
+//
+bool parsePercent(string flag, string text, double &value) {
+    double percent = 0;
+    size_t used = 0;
+    try {
+        percent = stod(text, &used);
+    } catch (const logic_error &) {
+        used = 0;
+    }
+    if (used == 0 || used != text.length() || !(percent > 0) ||
+        percent > 100) {
+        cout << "Bad value for " << flag << ": \"" << text
+             << "\" (a percentage above 0 and at most 100)" << endl;
+        printUsage();
+        return false;
+    }
+    value = percent;
+    return true;
+}
+
+//
+// runCommand
+// Runs a single command given on the command line.  Returns the process
+// exit code.
+//
+int runCommand(vector<string> args) {
+    string command = args[0];
+    string dictname;
+    vector<string> dictnames;
+    bool useLZ = false;
+    bool useBWT = false;
+    bool useBlocks = false;
+    bool useTokens = false;
+    int blockSize = 0;
+    string range;
+    bool verify = false;
+    bool append = false;
+    int requests = 10000;
+    int threads = 4;
+    size_t payloadSize = 4096;
+    string cachedir;
+    string storedir;
+    size_t maxMemory = 0;
+    size_t sampleBytes = 0;
+    double samplePercent = 0;
+    bool memoryReport = false;
+    lzconfig lz = LZ_DEFAULT_CONFIG;
+    const size_t maxSize = numeric_limits<size_t>::max();
+    size_t number = 0;
+    vector<string> files;
+    vector<string> options;  // everything but the files and the cache
+    for (unsigned int i = 1; i < args.size(); i++) {
+        unsigned int first = i;
+        if (args[i] == "--cache" && i + 1 < args.size()) {
+            cachedir = args[++i];
+            continue;
+        }
+        if (args[i] == "--memory") {
+            memoryReport = true;
+            continue;
+        }
+        if (args[i] == "--dict" && i + 1 < args.size()) {
+            dictname = args[++i];
+            dictnames.push_back(dictname);
+        } else if (args[i] == "--dedup" && i + 1 < args.size()) {
+            storedir = args[++i];
+        } else if (args[i] == "--lz") {
+            useLZ = true;
+        } else if (args[i] == "--bwt") {
+            useBWT = true;
+        } else if (args[i] == "--tokens") {
+            useTokens = true;
+        } else if (args[i] == "--range" && i + 1 < args.size()) {
+            range = args[++i];
+        } else if (args[i] == "--append") {
+            append = true;
+        } else if (args[i] == "--verify") {
+            verify = true;
+        } else if (args[i] == "--blocks") {
+            useBlocks = true;
+        } else if (args[i] == "--block" && i + 1 < args.size()) {
+            if (!parseNumber(args[first], args[++i], 1, BLOCK_MAX_SIZE / 1024,
+                             number)) {
+                return 1;
+            }
+            blockSize = (int)number * 1024;
+        } else if (args[i] == "--requests" && i + 1 < args.size()) {
+            if (!parseNumber(args[first], args[++i], 1, INT_MAX, number)) {
+                return 1;
+            }
+            requests = (int)number;
+        } else if (args[i] == "--threads" && i + 1 < args.size()) {
+            if (!parseNumber(args[first], args[++i], 1, 1024, number)) return 1;
+            threads = (int)number;
+        } else if (args[i] == "--size" && i + 1 < args.size()) {
+            if (!parseNumber(args[first], args[++i], 1, DAEMON_MAX_MESSAGE / 2,
+                             payloadSize)) {
+                return 1;
+            }
+        } else if (args[i] == "--window" && i + 1 < args.size()) {
+            if (!parseNumber(args[first], args[++i], LZ_MIN_WINDOW_BITS,
+                             LZ_MAX_WINDOW_BITS, number)) {
+                return 1;
+            }
+            lz.windowBits = (int)number;
+        } else if (args[i] == "--level" && i + 1 < args.size()) {
+            if (!parseNumber(args[first], args[++i], 0, 9, number)) return 1;
+            lz.level = (int)number;
+        } else if (args[i] == "--sample" && i + 1 < args.size()) {
+            if (!parseNumber(args[first], args[++i], 1, maxSize / 1024,
+                             number)) {
+                return 1;
+            }
+            sampleBytes = number * 1024;
+        } else if (args[i] == "--sampled" && i + 1 < args.size()) {
+            if (!parsePercent(args[first], args[++i], samplePercent)) return 1;
+        } else if (args[i] == "--max-memory" && i + 1 < args.size()) {
+            if (!parseNumber(args[first], args[++i], 1, maxSize / (1024 * 1024),
+                             number)) {
+                return 1;
+            }
+            maxMemory = number * 1024 * 1024;
+        } else {
+            files.push_back(args[i]);
+            continue;
+        }
+        options.insert(options.end(), args.begin() + first,
+                       args.begin() + i + 1);
+    }
+
+    if (memoryReport) {
+        vector<string> rest;
+        for (unsigned int i = 0; i < args.size(); i++) {
+            if (args[i] != "--memory") rest.push_back(args[i]);
+        }
+        int status = runCommand(rest);
+        printMemoryReport(maxMemory);
+        return status;
+    }
+
+    if (command == "train" && files.size() >= 3) {
+        string dictfile = files[0];
+        if (!parseNumber("the dictionary id", files[1], 0, INT_MAX, number)) {
+            return 1;
+        }
+        int id = (int)number;
+        vector<string> corpus(files.begin() + 2, files.end());
+        return trainDictionary(corpus, id, dictfile) ? 0 : 1;
+    } else if (command == "archive" && files.size() >= 2) {
+        vector<string> members(files.begin() + 1, files.end());
+        return archiveCompress(files[0], members) < 0 ? 1 : 0;
+    } else if (command == "extract" && files.size() >= 1 &&
+               files.size() <= 2) {
+        return archiveExtract(files[0], files.size() == 2 ? files[1] : "") ?
+               0 : 1;
+    } else if (command == "list" && files.size() == 1) {
+        return archiveList(files[0]) ? 0 : 1;
+    } else if (command == "compress" && cachedir != "" && !append &&
+               files.size() >= 1) {
+        huffcache cache;
+        if (!loadCache(cachedir, cache)) return 1;
+        string key;
+        for (unsigned int i = 0; i < options.size(); i++) {
+            key += options[i] + " ";
+        }
+        vector<unsigned char> dict;
+        if (dictname != "" && readFileBytes(dictname, dict)) {
+            key += hashName(contentHash(dict.data(), dict.size()));
+        }
+        int status = 0;
+        for (unsigned int i = 0; i < files.size(); i++) {
+            vector<string> single(1, command);
+            single.insert(single.end(), options.begin(), options.end());
+            single.push_back(files[i]);
+            if (!cachedCompress(cache, files[i], key, [&]() {
+                    return runCommand(single) == 0;
+                })) {
+                status = 1;
+            }
+        }
+        saveCache(cache);
+        printCacheStats(cache);
+        return status;
+    } else if (command == "compress" && storedir != "" && files.size() >= 1) {
+        size_t batch = dedupBatchSize(workingBudget(maxMemory));
+        return dedupCompress(storedir, files, batch) ? 0 : 1;
+    } else if (command == "estimate" && files.size() >= 1) {
+        return estimateFiles(files, sampleBytes) ? 0 : 1;
+    } else if (command == "profile" && files.size() == 1) {
+        return profileFile(files[0]) ? 0 : 1;
+    } else if (command == "convert" && files.size() >= 1) {
+        return convertLegacy(files, blockSize) ? 0 : 1;
+    } else if (command == "serve" && files.size() == 1) {
+        huffdaemon daemon;
+        for (unsigned int i = 0; i < dictnames.size(); i++) {
+            if (!daemon.addDictionary(dictnames[i])) {
+                cout << "Cannot load dictionary: " << dictnames[i] << endl;
+                return 1;
+            }
+        }
+        return daemon.serve(files[0]) ? 0 : 1;
+    } else if (command == "client" && files.size() == 2 &&
+               files[1] == "stats") {
+        huffclient client;
+        string report;
+        if (!client.connect(files[0]) || !client.stats(report)) {
+            cout << "No daemon on " << files[0] << endl;
+            return 1;
+        }
+        cout << report;
+        return 0;
+    } else if (command == "loadgen" && files.size() == 2) {
+        int dictId = -1;
+        if (dictname != "") {
+            daemondictionary dict;
+            if (!loadDaemonDictionary(dictname, dict)) return 1;
+            dictId = dict.id;
+        }
+        return runLoadGenerator(files[0], files[1], requests, threads,
+                                payloadSize, dictId) ? 0 : 1;
+    } else if ((command == "compress" || command == "decompress") &&
+               files.size() == 1) {
+        // the streaming modes fit their buffers into the budget; the
+        // others hold the whole input and must fit as they are
+        size_t budget = workingBudget(maxMemory);
+        size_t inputSize = 0;
+        long long mtime;
+        fileStamp(files[0], inputSize, mtime);
+        int workers = 0;
+        if (command == "compress" && useLZ) {
+            if (!checkMemoryBudget(inputSize * LZ_MEMORY_COST, budget)) {
+                return 1;
+            }
+            return lzCompress(files[0], lz) < 0 ? 1 : 0;
+        }
+        if (command == "compress" && useBWT) {
+            fitBWTBudget(budget, blockSize, workers);
+            return bwtCompress(files[0], blockSize, workers) < 0 ? 1 : 0;
+        }
+        if (command == "compress" && (append || useBlocks)) {
+            fitBlockBudget(budget, blockSize, workers);
+        }
+        if (command == "compress" && append) {
+            return blockAppend(files[0], blockSize, workers) < 0 ? 1 : 0;
+        }
+        if (command == "compress" && useBlocks) {
+            return blockCompress(files[0], blockSize, workers) < 0 ? 1 : 0;
+        }
+        if (command == "compress" && useTokens) {
+            if (!checkMemoryBudget(inputSize * TOKEN_MEMORY_COST, budget)) {
+                return 1;
+            }
+            return tokenCompress(files[0]) < 0 ? 1 : 0;
+        }
+        if (command == "compress" && samplePercent > 0) {
+            return sampledCompress(files[0], samplePercent) < 0 ? 1 : 0;
+        }
+        size_t cost = dictname == "" ? LEGACY_MEMORY_COST :
+                      DICTIONARY_MEMORY_COST;
+        if (command == "compress" &&
+            !checkMemoryBudget(inputSize * cost, budget)) {
+            return 1;
+        }
+        char mode = headerMode(files[0]);
+        if (command == "decompress" && range != "") {
+            size_t colon = range.find(':');
+            if (mode != BLOCK_MODE || colon == string::npos) {
+                cout << "--range needs a block file and offset:length"
+                     << endl;
+                return 1;
+            }
+            size_t offset = 0, length = 0;
+            if (!parseNumber("--range", range.substr(0, colon), 0, maxSize,
+                             offset) ||
+                !parseNumber("--range", range.substr(colon + 1), 0, maxSize,
+                             length)) {
+                return 1;
+            }
+            return blockDecompressRange(files[0], offset, length, verify) ?
+                   0 : 1;
+        }
+        if (command == "decompress" && mode == LZ_MODE) {
+            return lzDecompress(files[0]) ? 0 : 1;
+        }
+        if (command == "decompress" && mode == BWT_MODE) {
+            return bwtDecompress(files[0]) ? 0 : 1;
+        }
+        if (command == "decompress" && mode == BLOCK_MODE) {
+            return blockDecompress(files[0], verify) ? 0 : 1;
+        }
+        if (command == "decompress" && mode == DEDUP_MODE) {
+            return dedupDecompress(files[0], verify) ? 0 : 1;
+        }
+        if (command == "decompress" && mode == TOKEN_MODE) {
+            return tokenDecompress(files[0]) ? 0 : 1;
+        }
+        if (command == "decompress" && dictname == "" &&
+            mode == DICTIONARY_MODE) {
+            cout << files[0] << " was compressed with a dictionary; "
+                 << "decompress it with --dict <dict>." << endl;
+            return 1;
+        }
+        if (command == "decompress" && dictname == "" && mode != 0) {
+            cout << "Unknown compressed format: " << files[0] << endl;
+            return 1;
+        }
+        if (dictname == "") {
+            if (command == "compress") compress(files[0]);
+            else decompress(files[0]);
+            return 0;
+        }
+        huffdict dict;
+        if (!loadDictionary(dictname, dict)) return 1;
+        int status = 0;
+        if (command == "compress") {
+            compressWithDictionary(files[0], dict);
+        } else if (checkDictionaryId(dictionaryFileId(files[0]), dict)) {
+            decompressWithDictionary(files[0], dict);
+        } else {
+            status = 1;
+        }
+        freeDictionary(dict);
+        return status;
+    }
+    printUsage();
+    return 1;
+}
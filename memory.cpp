@@ -0,0 +1,149 @@
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "memory.h"
+
+using namespace std;
+
+static const char* const MEMORY_NAMES[MEMORY_SUBSYSTEMS] = {
+    "tree", "queue", "hashmap", "text", "bits", "blocks", "codec"
+};
+
+struct memorycounter {
+    atomic<size_t> bytes;
+    atomic<size_t> peak;
+    atomic<size_t> allocations;
+};
+
+static memorycounter counters[MEMORY_SUBSYSTEMS];
+
+//
+// *This function counts bytes allocated for subsystem.
+//
+void trackAllocation(int subsystem, size_t bytes) {
+    memorycounter &c = counters[subsystem];
+    size_t now = c.bytes.fetch_add(bytes, memory_order_relaxed) + bytes;
+    c.allocations.fetch_add(1, memory_order_relaxed);
+    size_t peak = c.peak.load(memory_order_relaxed);
+    while (now > peak &&
+           !c.peak.compare_exchange_weak(peak, now, memory_order_relaxed)) {
+    }
+}
+
+//
+// *This function counts bytes of subsystem as freed.
+//
+void trackRelease(int subsystem, size_t bytes) {
+    counters[subsystem].bytes.fetch_sub(bytes, memory_order_relaxed);
+}
+
+//
+// *This function allocates bytes and counts them for subsystem.
+//
+void* trackedAllocate(int subsystem, size_t bytes) {
+    void* p = ::operator new(bytes);
+    trackAllocation(subsystem, bytes);
+    return p;
+}
+
+//
+// *This function frees p, bytes long, allocated by trackedAllocate.
+//
+void trackedFree(int subsystem, void* p, size_t bytes) {
+    if (p == nullptr) return;
+    trackRelease(subsystem, bytes);
+    ::operator delete(p);
+}
+
+//
+// *These functions return a subsystem's bytes now, its most bytes at once,
+// and how many allocations it has made.
+//
+size_t trackedBytes(int subsystem) {
+    return counters[subsystem].bytes.load();
+}
+
+size_t trackedPeak(int subsystem) {
+    return counters[subsystem].peak.load();
+}
+
+size_t trackedAllocations(int subsystem) {
+    return counters[subsystem].allocations.load();
+}
+
+//
+// *This function returns the process's resident set size in bytes, or 0 if
+// it is not known.
+//
+size_t currentRSS() {
+    ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+//
+// *This function returns the most resident memory the process has used, in
+// bytes.
+//
+size_t peakRSS() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+//
+// *This function returns what is left of budget bytes for buffers after
+// what the process already has resident (code, libraries, stacks), at
+// least 1.  A budget of 0, for none, stays 0.
+//
+size_t workingBudget(size_t budget) {
+    if (budget == 0) return 0;
+    size_t used = currentRSS();
+    return budget > used ? budget - used : 1;
+}
+
+//
+// *This function checks that a job needing about needed bytes fits in
+// budget bytes (0 for no limit), and says so if not.
+//
+bool checkMemoryBudget(size_t needed, size_t budget) {
+    if (budget == 0 || needed <= budget) return true;
+    cout << "Needs about " << needed / (1024 * 1024) << " MB, more than the "
+         << budget / (1024 * 1024) << " MB budget; --blocks works in "
+         << "bounded memory." << endl;
+    return false;
+}
+
+//
+// *This function prints each subsystem's counts and the resident set size.
+// budget is the --max-memory limit, or 0 for none.
+//
+void printMemoryReport(size_t budget) {
+    const double KB = 1024;
+    cout << left << setw(10) << "memory" << right << setw(14) << "now KB"
+         << setw(14) << "peak KB" << setw(14) << "allocations" << endl;
+    cout << fixed << setprecision(1);
+    for (int s = 0; s < MEMORY_SUBSYSTEMS; s++) {
+        if (trackedAllocations(s) == 0) continue;
+        cout << left << setw(10) << MEMORY_NAMES[s] << right << setw(14)
+             << trackedBytes(s) / KB << setw(14) << trackedPeak(s) / KB
+             << setw(14) << trackedAllocations(s) << endl;
+    }
+    cout << "RSS " << currentRSS() / KB / KB << " MB, peak "
+         << peakRSS() / KB / KB << " MB";
+    if (budget > 0) {
+        cout << " (budget " << budget / KB / KB << " MB"
+             << (peakRSS() > budget ? ", EXCEEDED" : "") << ")";
+    }
+    cout << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
@@ -0,0 +1,104 @@
+//
+// memory.h
+//
+// Memory accounting.  Each subsystem that allocates in proportion to its
+// input counts its heap bytes and allocations here, through:
+//      - class operator new and delete for node types (tree, queue and
+//        hashmap nodes, codec contexts), so every "new" of them counts;
+//      - trackedallocator, an STL allocator, for containers whose type can
+//        name their subsystem (the block pipeline's buffers);
+//      - memoryhold, for a buffer whose type is fixed by an interface (the
+//        strings compress and decompress return), held for a scope.
+// Counters are atomic, so threads can allocate at once.  Peak and current
+// resident set size come from the operating system and cover everything,
+// counted or not.
+//
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+using namespace std;
+
+const int MEMORY_TREE = 0;      // HuffmanNode
+const int MEMORY_QUEUE = 1;     // priorityqueue nodes
+const int MEMORY_HASHMAP = 2;   // hashmap nodes and buckets
+const int MEMORY_TEXT = 3;      // whole-file text compress and decompress
+const int MEMORY_BITS = 4;      // encode's bit string
+const int MEMORY_BLOCKS = 5;    // block pipeline buffers
+const int MEMORY_CODEC = 6;     // huffcontext
+const int MEMORY_SUBSYSTEMS = 7;
+
+void trackAllocation(int subsystem, size_t bytes);
+void trackRelease(int subsystem, size_t bytes);
+void* trackedAllocate(int subsystem, size_t bytes);
+void trackedFree(int subsystem, void* p, size_t bytes);
+size_t trackedBytes(int subsystem);
+size_t trackedPeak(int subsystem);
+size_t trackedAllocations(int subsystem);
+size_t currentRSS();
+size_t peakRSS();
+size_t workingBudget(size_t budget);
+bool checkMemoryBudget(size_t needed, size_t budget);
+void printMemoryReport(size_t budget);
+
+//
+// An STL allocator that counts what it allocates against Subsystem.
+//
+template <class T, int Subsystem>
+struct trackedallocator {
+    typedef T value_type;
+
+    template <class U>
+    struct rebind {
+        typedef trackedallocator<U, Subsystem> other;
+    };
+
+    trackedallocator() {}
+
+    template <class U>
+    trackedallocator(const trackedallocator<U, Subsystem> &) {}
+
+    T* allocate(size_t n) {
+        return (T*)trackedAllocate(Subsystem, n * sizeof(T));
+    }
+
+    void deallocate(T* p, size_t n) {
+        trackedFree(Subsystem, p, n * sizeof(T));
+    }
+};
+
+template <class T, class U, int Subsystem>
+bool operator==(const trackedallocator<T, Subsystem> &,
+                const trackedallocator<U, Subsystem> &) {
+    return true;
+}
+
+template <class T, class U, int Subsystem>
+bool operator!=(const trackedallocator<T, Subsystem> &,
+                const trackedallocator<U, Subsystem> &) {
+    return false;
+}
+
+//
+// Counts bytes someone else allocated against a subsystem until it goes out
+// of scope.
+//
+class memoryhold {
+public:
+    memoryhold(int subsystem, size_t bytes)
+        : subsystem(subsystem), bytes(bytes) {
+        trackAllocation(subsystem, bytes);
+    }
+
+    ~memoryhold() {
+        trackRelease(subsystem, bytes);
+    }
+
+private:
+    memoryhold(const memoryhold &);
+    memoryhold &operator=(const memoryhold &);
+
+    int subsystem;
+    size_t bytes;
+};
@@ -0,0 +1,43 @@
+//
+// parallel.h
+//
+// A minimal parallel loop for independent blocks of work.  parallelFor runs
+// fn(0) .. fn(count - 1) on up to hardware_concurrency() threads, each
+// thread taking the next unclaimed index, and returns when all are done.
+//
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+//
+// *This function returns the number of worker threads to use.
+//
+inline int workerCount() {
+    int n = (int)thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+//
+// *This function calls fn for every index in [0, count) using up to
+// workerCount() threads.
+//
+inline void parallelFor(int count, function<void(int)> fn) {
+    int threads = min(count, workerCount());
+    if (threads <= 1) {
+        for (int i = 0; i < count; i++) fn(i);
+        return;
+    }
+    atomic<int> next(0);
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(thread([&]() {
+            for (int i = next++; i < count; i = next++) fn(i);
+        }));
+    }
+    for (unsigned int t = 0; t < workers.size(); t++) workers[t].join();
+}
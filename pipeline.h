@@ -0,0 +1,176 @@
+//
+// pipeline.h
+//
+// A pipelined executor for block coding.  A reader thread fills block
+// buffers, encoder workers code them, and a writer thread writes them in
+// input order, so reading, coding and writing overlap and the whole runs at
+// the speed of the slowest stage rather than their sum.  The stages are
+// connected by bounded ring buffers, and a fixed pool of slots (twice the
+// number of workers, plus two) is handed around between them, so buffers are
+// reused and memory stays bounded however large the input is.
+//
+// The reader and writer use ordinary blocking stream I/O on their own
+// threads.  An io_uring reader would save the copies and system calls, but
+// the thread version needs nothing beyond the standard library and already
+// keeps the encoders busy while it waits.
+//
+// Each slot goes through:
+//      read     reader thread; returns false at the end of the input
+//      prepare  any worker, in any order
+//      order    any worker, one slot at a time in input order, for state
+//               that one block passes to the next
+//      finish   any worker, in any order
+//      write    writer thread, in input order
+//
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "parallel.h"
+
+using namespace std;
+
+//
+// A bounded blocking FIFO queue.
+//
+template <class T>
+class ringbuffer {
+public:
+    ringbuffer(int capacity) : items(capacity), head(0), count(0),
+                               closed(false) {}
+
+    //
+    // *This function adds item, waiting while the buffer is full.
+    //
+    void push(const T &item) {
+        unique_lock<mutex> lock(m);
+        notFull.wait(lock, [&]() { return count < (int)items.size(); });
+        items[(head + count) % items.size()] = item;
+        count++;
+        notEmpty.notify_one();
+    }
+
+    //
+    // *This function removes the oldest item, waiting while the buffer is
+    // empty.  Returns false once the buffer is closed and empty.
+    //
+    bool pop(T &item) {
+        unique_lock<mutex> lock(m);
+        notEmpty.wait(lock, [&]() { return count > 0 || closed; });
+        if (count == 0) return false;
+        item = items[head];
+        head = (head + 1) % items.size();
+        count--;
+        notFull.notify_one();
+        return true;
+    }
+
+    //
+    // *This function marks the end of the items; pop returns false once the
+    // remaining ones are taken.
+    //
+    void close() {
+        lock_guard<mutex> lock(m);
+        closed = true;
+        notEmpty.notify_all();
+    }
+
+private:
+    vector<T> items;
+    int head;
+    int count;
+    bool closed;
+    mutex m;
+    condition_variable notEmpty;
+    condition_variable notFull;
+};
+
+template <class Slot>
+struct pipelinestages {
+    function<bool(Slot&)> read;
+    function<void(Slot&)> prepare;
+    function<void(Slot&)> order;
+    function<void(Slot&)> finish;
+    function<void(Slot&)> write;
+};
+
+//
+// *This function returns the number of slots runPipeline uses for workers
+// encoder threads.
+//
+inline int pipelineSlots(int workers) {
+    return 2 * max(workers, 1) + 2;
+}
+
+//
+// *This function runs slots through the stages until read returns false,
+// with workers encoder threads, and returns when everything is written.
+//
+template <class Slot>
+void runPipeline(pipelinestages<Slot> &stages, int workers) {
+    if (workers < 1) workers = 1;
+    int slotCount = pipelineSlots(workers);
+    vector<Slot> slots(slotCount);
+    vector<size_t> sequence(slotCount);
+    ringbuffer<int> freeSlots(slotCount), work(slotCount), done(slotCount);
+    for (int i = 0; i < slotCount; i++) freeSlots.push(i);
+
+    thread reader([&]() {
+        int i;
+        for (size_t next = 0; freeSlots.pop(i); next++) {
+            if (!stages.read(slots[i])) break;
+            sequence[i] = next;
+            work.push(i);
+        }
+        work.close();
+    });
+
+    mutex orderLock;
+    condition_variable orderTurn;
+    size_t nextOrder = 0;
+    vector<thread> encoders;
+    for (int t = 0; t < workers; t++) {
+        encoders.push_back(thread([&]() {
+            int i;
+            while (work.pop(i)) {
+                stages.prepare(slots[i]);
+                {
+                    unique_lock<mutex> lock(orderLock);
+                    orderTurn.wait(lock, [&]() {
+                        return nextOrder == sequence[i];
+                    });
+                    stages.order(slots[i]);
+                    nextOrder++;
+                    orderTurn.notify_all();
+                }
+                stages.finish(slots[i]);
+                done.push(i);
+            }
+        }));
+    }
+
+    thread writer([&]() {
+        // slots in flight have distinct sequence numbers modulo slotCount
+        vector<int> waiting(slotCount, -1);
+        size_t next = 0;
+        int i;
+        while (done.pop(i)) {
+            waiting[sequence[i] % slotCount] = i;
+            while (waiting[next % slotCount] >= 0) {
+                int j = waiting[next % slotCount];
+                waiting[next % slotCount] = -1;
+                stages.write(slots[j]);
+                freeSlots.push(j);
+                next++;
+            }
+        }
+    });
+
+    reader.join();
+    for (unsigned int t = 0; t < encoders.size(); t++) encoders[t].join();
+    done.close();
+    writer.join();
+}
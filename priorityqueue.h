@@ -22,6 +22,7 @@
 #include <iostream>
 #include <sstream>
 #include <set>
+#include "memory.h"
 
 using namespace std;
 
@@ -36,6 +37,13 @@ private:
         NODE* link;  // links to linked list of NODES with duplicate priorities
         NODE* left;  // links to left child
         NODE* right;  // links to right child
+
+        static void* operator new(size_t size) {
+            return trackedAllocate(MEMORY_QUEUE, size);
+        }
+        static void operator delete(void* p, size_t size) {
+            trackedFree(MEMORY_QUEUE, p, size);
+        }
     };
     NODE* root;  // pointer to root node of the BST
     int size;  // # of elements in the pqueue
@@ -271,7 +279,7 @@ public:
     // duplicate priorities
     //
     T dequeue() {
-        T valueOut;
+        T valueOut = T();
         if (root != nullptr) {
             // 1. traversal
             NODE* cur = nullptr;
@@ -441,7 +449,7 @@ public:
     // duplicate priorities
     //
     T peek() {
-        T valueOut;
+        T valueOut = T();
         if (root != nullptr) {
 
             // 1. traversal
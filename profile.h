@@ -0,0 +1,394 @@
+//
+// profile.h
+//
+// Per-phase profiling with the CPU's performance counters, for
+//      program.exe profile <file>
+// Each coder's work on the file is split into its phases (counting,
+// building the tree, encoding, decoding, ...), and each phase is measured
+// with perf_event_open counters for cycles, instructions, branch misses and
+// L1 data and last-level cache read misses, read as the phase starts and
+// ends.  The report gives each phase's time and its counts per MB of input,
+// with instructions per cycle.
+//
+// The counters count this thread in user space only, so the coders run on
+// one thread here.  A counter that cannot be opened (not Linux,
+// perf_event_paranoid too high, no PMU in a virtual machine or container)
+// is shown as "-" and the phases are still timed.  When the kernel has more
+// counters than the CPU can run at once it takes turns, and counts are
+// scaled up by the share of time each one ran.
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include "bitstream.h"
+#include "block.h"
+#include "codec.h"
+#include "util.h"
+
+using namespace std;
+
+const int PERF_CYCLES = 0;
+const int PERF_INSTRUCTIONS = 1;
+const int PERF_BRANCH_MISSES = 2;
+const int PERF_L1_MISSES = 3;
+const int PERF_LLC_MISSES = 4;
+const int PERF_COUNTERS = 5;
+const char* const PERF_COUNTER_NAMES[PERF_COUNTERS] = {
+    "cycles", "instr", "br-miss", "L1d-miss", "LLC-miss"
+};
+
+//
+// The counters of this thread, opened once and left running; a phase's
+// counts are the difference of two reads.
+//
+class perfcounters {
+public:
+    perfcounters() {
+        for (int c = 0; c < PERF_COUNTERS; c++) fds[c] = -1;
+#ifdef __linux__
+        const uint64_t l1 = PERF_COUNT_HW_CACHE_L1D |
+                            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        const uint64_t llc = PERF_COUNT_HW_CACHE_LL |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        fds[PERF_CYCLES] = open(PERF_TYPE_HARDWARE,
+                                PERF_COUNT_HW_CPU_CYCLES);
+        fds[PERF_INSTRUCTIONS] = open(PERF_TYPE_HARDWARE,
+                                      PERF_COUNT_HW_INSTRUCTIONS);
+        fds[PERF_BRANCH_MISSES] = open(PERF_TYPE_HARDWARE,
+                                       PERF_COUNT_HW_BRANCH_MISSES);
+        fds[PERF_L1_MISSES] = open(PERF_TYPE_HW_CACHE, l1);
+        fds[PERF_LLC_MISSES] = open(PERF_TYPE_HW_CACHE, llc);
+#else
+        error = "perf_event_open is Linux only";
+#endif
+    }
+
+    ~perfcounters() {
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            if (fds[c] >= 0) close(fds[c]);
+        }
+    }
+
+    //
+    // *This function returns true if counter could be opened.
+    //
+    bool available(int counter) const {
+        return fds[counter] >= 0;
+    }
+
+    //
+    // *This function reads every counter into values, scaled for the time
+    // it was not running.  Counters that are not available read 0.
+    //
+    void read(double* values) const {
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            values[c] = 0;
+            uint64_t v[3];  // value, time enabled, time running
+            if (fds[c] < 0 || ::read(fds[c], v, sizeof(v)) != sizeof(v)) {
+                continue;
+            }
+            values[c] = v[2] == 0 ? 0 : (double)v[0] * v[1] / v[2];
+        }
+    }
+
+    string error;  // why the first counter that failed could not be opened
+
+private:
+    int fds[PERF_COUNTERS];
+
+#ifdef __linux__
+    //
+    // *This function opens and starts one counter.  Returns its descriptor,
+    // or -1 (keeping the reason in error) if it cannot be opened.
+    //
+    int open(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd < 0) {
+            if (error == "") error = strerror(errno);
+            return -1;
+        }
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        return fd;
+    }
+#endif
+};
+
+struct phasecounts {
+    string coder;
+    string phase;
+    size_t bytes;  // input the phase worked on
+    double seconds;
+    double values[PERF_COUNTERS];
+};
+
+//
+// Accumulates counts per phase.  A phase named again (one per block, say)
+// adds to its earlier counts.
+//
+class profiler {
+public:
+    profiler() : current(-1) {}
+
+    //
+    // *This function starts measuring phase of coder, which works on bytes
+    // bytes of input.
+    //
+    void begin(string coder, string phase, size_t bytes) {
+        current = -1;
+        for (unsigned int i = 0; i < phases.size(); i++) {
+            if (phases[i].coder == coder && phases[i].phase == phase) {
+                current = i;
+            }
+        }
+        if (current < 0) {
+            phasecounts p;
+            p.coder = coder;
+            p.phase = phase;
+            p.bytes = 0;
+            p.seconds = 0;
+            for (int c = 0; c < PERF_COUNTERS; c++) p.values[c] = 0;
+            phases.push_back(p);
+            current = (int)phases.size() - 1;
+        }
+        phases[current].bytes += bytes;
+        counters.read(startValues);
+        start = chrono::steady_clock::now();
+    }
+
+    //
+    // *This function stops measuring the phase begin started.
+    //
+    void end() {
+        auto stop = chrono::steady_clock::now();
+        double values[PERF_COUNTERS];
+        counters.read(values);
+        phasecounts &p = phases[current];
+        p.seconds += chrono::duration<double>(stop - start).count();
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            p.values[c] += values[c] - startValues[c];
+        }
+    }
+
+    //
+    // *This function prints a line per phase with its time and its counts
+    // per MB of input.
+    //
+    void report() {
+        bool any = false;
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            any = any || counters.available(c);
+        }
+        if (!any) {
+            cout << "Performance counters unavailable (" << counters.error
+                 << "); timing only." << endl;
+        }
+        cout << left << setw(8) << "coder" << setw(10) << "phase" << right
+             << setw(10) << "ms" << setw(10) << "MB/s";
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            cout << setw(11) << PERF_COUNTER_NAMES[c];
+        }
+        cout << setw(6) << "IPC" << endl;
+        cout << setw(36) << "" << "  (counts per MB of input)" << endl;
+        for (unsigned int i = 0; i < phases.size(); i++) {
+            const phasecounts &p = phases[i];
+            double megabytes = max((double)p.bytes, 1.0) / (1024 * 1024);
+            cout << left << setw(8) << p.coder << setw(10) << p.phase
+                 << right << fixed << setprecision(2) << setw(10)
+                 << p.seconds * 1000 << setprecision(1) << setw(10)
+                 << (p.seconds > 0 ? megabytes / p.seconds : 0.0);
+            cout.unsetf(ios::fixed);
+            cout << setprecision(3);
+            for (int c = 0; c < PERF_COUNTERS; c++) {
+                if (counters.available(c)) {
+                    cout << setw(11) << p.values[c] / megabytes;
+                } else {
+                    cout << setw(11) << "-";
+                }
+            }
+            if (counters.available(PERF_CYCLES) &&
+                counters.available(PERF_INSTRUCTIONS) &&
+                p.values[PERF_CYCLES] > 0) {
+                cout << fixed << setprecision(2) << setw(6)
+                     << p.values[PERF_INSTRUCTIONS] / p.values[PERF_CYCLES];
+                cout.unsetf(ios::fixed);
+            } else {
+                cout << setw(6) << "-";
+            }
+            cout << endl;
+        }
+        cout << setprecision(6);
+    }
+
+private:
+    perfcounters counters;
+    vector<phasecounts> phases;
+    int current;
+    double startValues[PERF_COUNTERS];
+    chrono::steady_clock::time_point start;
+};
+
+//
+// *This function profiles compress and decompress's phases on data, by way
+// of a temporary file for the encoded bits.  Returns false if the result
+// does not round trip.
+//
+inline bool profileLegacy(const string &data, profiler &prof) {
+    char tempname[] = "/tmp/huffprofileXXXXXX";
+    int fd = mkstemp(tempname);
+    if (fd < 0) {
+        cout << "Cannot create a temporary file." << endl;
+        return false;
+    }
+    close(fd);
+
+    prof.begin("legacy", "count", data.size());
+    hashmapF frequencyMap;
+    buildFrequencyMap(data, false, frequencyMap);
+    prof.end();
+    prof.begin("legacy", "tree", data.size());
+    HuffmanNode* encodingTree = buildEncodingTree(frequencyMap);
+    prof.end();
+    prof.begin("legacy", "map", data.size());
+    hashmapE encodingMap = buildEncodingMap(encodingTree);
+    prof.end();
+    prof.begin("legacy", "encode", data.size());
+    {
+        ofbitstream output(tempname);
+        istringstream input(data);
+        output << frequencyMap;
+        int size = 0;
+        encode(input, encodingMap, output, size, true);
+    }
+    prof.end();
+    freeTree(encodingTree);
+
+    prof.begin("legacy", "header", data.size());
+    ifbitstream input(tempname);
+    hashmapF readMap;
+    input >> readMap;
+    HuffmanNode* decodingTree = buildEncodingTree(readMap);
+    prof.end();
+    prof.begin("legacy", "decode", data.size());
+    ofstream output("/dev/null");
+    string result = decode(input, decodingTree, output);
+    prof.end();
+    freeTree(decodingTree);
+    remove(tempname);
+    return result == data;
+}
+
+//
+// *This function profiles the block coder's phases on data, one
+// BLOCK_DEFAULT_SIZE block at a time.  Returns false if the result does not
+// round trip.
+//
+inline bool profileBlocks(const vector<unsigned char> &data, profiler &prof) {
+    size_t count = (data.size() + BLOCK_DEFAULT_SIZE - 1) / BLOCK_DEFAULT_SIZE;
+    vector<huffblock> blocks(count);
+    blocktable previous = {0, hashmapF()};
+    for (size_t b = 0; b < count; b++) {
+        size_t start = b * BLOCK_DEFAULT_SIZE;
+        size_t n = min(data.size() - start, (size_t)BLOCK_DEFAULT_SIZE);
+        blockplan plan;
+        prof.begin("blocks", "plan", n);
+        planBlock(data.data() + start, n, blocks[b], plan);
+        prof.end();
+        prof.begin("blocks", "choose", n);
+        chooseBackend(plan, blocks[b], &previous);
+        prof.end();
+        prof.begin("blocks", "encode", n);
+        codeBlock(plan, blocks[b]);
+        prof.end();
+        keepTable(blocks[b], previous);
+    }
+    bool ok = true;
+    vector<unsigned char> restored, out;
+    previous = {0, hashmapF()};
+    for (size_t b = 0; b < count; b++) {
+        prof.begin("blocks", "decode", blocks[b].rawSize);
+        ok = resolveTable(blocks[b], previous) && decodeBlock(blocks[b], out) &&
+             ok;
+        prof.end();
+        restored.insert(restored.end(), out.begin(), out.end());
+    }
+    return ok && restored == data;
+}
+
+//
+// *This function profiles the buffer codec on data.  Returns false if the
+// result does not round trip.
+//
+inline bool profileCodec(const vector<unsigned char> &data, profiler &prof) {
+    huffcontext* ctx = new huffcontext;
+    vector<unsigned char> compressed(compressBound(data.size()));
+    vector<unsigned char> restored(data.size());
+    prof.begin("codec", "encode", data.size());
+    size_t size = compress(data.data(), data.size(), compressed.data(),
+                           compressed.size(), *ctx);
+    prof.end();
+    prof.begin("codec", "decode", data.size());
+    size_t restoredSize = decompress(compressed.data(), size,
+                                     restored.data(), restored.size(), *ctx);
+    prof.end();
+    delete ctx;
+    return restoredSize == data.size() && restored == data;
+}
+
+//
+// *This function profiles every coder's phases on filename and prints the
+// report.  Returns false if the file cannot be read or a coder does not
+// round trip.
+//
+inline bool profileFile(string filename) {
+    vector<unsigned char> data;
+    if (!readFileBytes(filename, data)) return false;
+    profiler prof;
+    // compress stops at a byte equal to EOF, so the legacy coder gets what
+    // it would read
+    string text(data.begin(), data.end());
+    text = text.substr(0, text.find((char)EOF));
+    bool ok = true;
+    if (!profileLegacy(text, prof)) {
+        cout << "legacy coder did not round trip" << endl;
+        ok = false;
+    }
+    if (!profileBlocks(data, prof)) {
+        cout << "block coder did not round trip" << endl;
+        ok = false;
+    }
+    if (!profileCodec(data, prof)) {
+        cout << "buffer codec did not round trip" << endl;
+        ok = false;
+    }
+    cout << filename << ": " << data.size() << " bytes" << endl;
+    prof.report();
+    return ok;
+}
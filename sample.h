@@ -0,0 +1,179 @@
+//
+// sample.h
+//
+// Sampled compress for inputs too large to read twice: "program.exe
+// compress --sampled <percent> <file>" builds the frequency map from about
+// that percent of the file instead of all of it, then encodes the file in
+// one streaming pass, so output starts after the sample rather than after a
+// full read.
+//      - The sample is SAMPLE_CHUNK_SIZE chunks, one from each equal stride
+//        of the file at a pseudo-random offset within it, so periodic data
+//        (fixed-size records) does not alias with the stride.
+//      - Every byte value gets a count of at least 1 (add-one smoothing), so
+//        bytes the sample missed still have a code; a file small enough to
+//        be sampled whole keeps its exact counts.  Counts are scaled down
+//        to keep the tree's total under SAMPLE_MAX_TOTAL, which keeps both
+//        HuffmanNode's int counts and the code lengths in range.
+//      - The output is the format compress writes, a "{k:v, ...}" map and
+//        the bitstream ending in PSEUDO_EOF, so decompress and convert read
+//        it as they are.  Unlike compress, bytes after a 0xFF are kept.
+// While encoding, the exact counts are kept, and at the end the size is
+// compared with what the exact map would have given (estimate.h).
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdint.h>
+#include "hashmap.h"
+#include "bitbuffer.h"
+#include "huffcode.h"
+#include "estimate.h"
+#include "util.h"
+
+using namespace std;
+
+const size_t SAMPLE_CHUNK_SIZE = 64 * 1024;
+const size_t SAMPLE_IO_SIZE = 1024 * 1024;
+const uint64_t SAMPLE_MAX_TOTAL = (uint64_t)1 << 30;
+
+//
+// *This function counts the bytes of about percent of input, n bytes long,
+// into counts.  Returns the number of bytes read.
+//
+inline size_t sampleCounts(ifstream &input, size_t n, double percent,
+                           vector<uint64_t> &counts) {
+    size_t want = (size_t)(n * percent / 100);
+    size_t chunks = (want + SAMPLE_CHUNK_SIZE - 1) / SAMPLE_CHUNK_SIZE;
+    if (chunks == 0) chunks = 1;
+    size_t stride = n / chunks;
+    vector<unsigned char> chunk(SAMPLE_CHUNK_SIZE);
+    uint32_t state = 2463534242u;  // xorshift32
+    size_t sampled = 0;
+    for (size_t c = 0; c < chunks; c++) {
+        size_t start = c * stride;
+        if (stride > SAMPLE_CHUNK_SIZE) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            start += state % (stride - SAMPLE_CHUNK_SIZE + 1);
+        }
+        input.clear();
+        input.seekg(start);
+        input.read((char*)chunk.data(), SAMPLE_CHUNK_SIZE);
+        size_t got = (size_t)input.gcount();
+        for (size_t i = 0; i < got; i++) counts[chunk[i]]++;
+        sampled += got;
+    }
+    input.clear();
+    input.seekg(0);
+    return sampled;
+}
+
+//
+// *This function fills map from the sample counts, keyed by signed char as
+// compress keys them, with PSEUDO_EOF.  Counts are scaled down under
+// SAMPLE_MAX_TOTAL; if smooth is true every byte gets one more, otherwise
+// (the sample was the whole file) only the bytes seen are kept.
+//
+inline void sampledFrequencyMap(const vector<uint64_t> &counts, bool smooth,
+                                hashmapF &map) {
+    uint64_t total = 0;
+    for (int b = 0; b < 256; b++) total += counts[b];
+    int shift = 0;
+    while ((total >> shift) > SAMPLE_MAX_TOTAL) shift++;
+    for (int b = 0; b < 256; b++) {
+        int count = (int)(counts[b] >> shift);
+        if (smooth || (counts[b] > 0 && count == 0)) count++;
+        if (count > 0) map.put((int)(char)b, count);
+    }
+    map.put(PSEUDO_EOF, 1);
+}
+
+//
+// *Helper for sampledCompress: fills table, indexed by byte and PSEUDO_EOF,
+// with the codes of tree's leaves.
+//
+inline void _sampleCodes(HuffmanNode* node, vector<HuffmanCode> &table,
+                         uint64_t bits, int length) {
+    if (node == nullptr) return;
+    if (node->character != NOT_A_CHAR) {
+        int symbol = node->character == PSEUDO_EOF ?
+                     PSEUDO_EOF : (unsigned char)node->character;
+        table[symbol].bits = bits;
+        table[symbol].length = length;
+        return;
+    }
+    _sampleCodes(node->zero, table, bits, length + 1);
+    _sampleCodes(node->one, table, bits | ((uint64_t)1 << length),
+                 length + 1);
+}
+
+//
+// *This function compresses filename into (filename + ".huf") with a map
+// built from about percent of it, and reports the cost of sampling.
+// Returns the compressed size in bytes, or -1 on error.
+//
+inline long sampledCompress(string filename, double percent) {
+    auto start = chrono::steady_clock::now();
+    ifstream input(filename, ios::binary);
+    if (!input.is_open()) {
+        cout << "File does not exist: " << filename << endl;
+        return -1;
+    }
+    input.seekg(0, ios::end);
+    size_t n = (size_t)input.tellg();
+    input.seekg(0);
+
+    vector<uint64_t> counts(256, 0);
+    size_t sampled = sampleCounts(input, n, percent, counts);
+    hashmapF map;
+    sampledFrequencyMap(counts, sampled < n, map);
+    HuffmanNode* tree = buildEncodingTree(map);
+    vector<HuffmanCode> table(PSEUDO_EOF + 1);
+    _sampleCodes(tree, table, 0, 0);
+    freeTree(tree);
+
+    ofstream output(filename + ".huf", ios::binary);
+    output << map;
+    output.flush();
+    double firstByte = chrono::duration<double>(
+        chrono::steady_clock::now() - start).count();
+
+    // encode a read at a time, writing the whole bytes of each
+    vector<uint64_t> exact(256, 0);
+    vector<unsigned char> in(SAMPLE_IO_SIZE), out;
+    obitbuffer bits;
+    while (input) {
+        input.read((char*)in.data(), SAMPLE_IO_SIZE);
+        size_t got = (size_t)input.gcount();
+        for (size_t i = 0; i < got; i++) {
+            exact[in[i]]++;
+            writeSymbol(bits, table, in[i]);
+        }
+        bits.takeBytes(out);
+        writeBytes(output, out.data(), out.size());
+    }
+    writeSymbol(bits, table, PSEUDO_EOF);
+    vector<unsigned char> &rest = bits.bytes();
+    writeBytes(output, rest.data(), rest.size());
+    long size = (long)output.tellp();
+    output.close();
+
+    size_t best = legacySize(exact);
+    cout << "Sampled " << sampled << " of " << n << " bytes ("
+         << fixed << setprecision(2) << (n > 0 ? 100.0 * sampled / n : 0.0)
+         << "%), output began after "
+         << setprecision(1) << firstByte * 1000 << " ms" << endl;
+    double loss = best > 0 ? 100.0 * ((double)size - best) / best : 0.0;
+    cout << size << " bytes against " << best << " with the exact counts: "
+         << setprecision(2) << fabs(loss) << "% "
+         << (loss < 0 ? "smaller" : "larger") << endl;
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+    return size;
+}
@@ -0,0 +1,186 @@
+//
+// test.cpp
+//
+// Round-trip checks for the library API, built against libhuff and run by
+// "make test" before test.sh checks the command line:
+//      test.exe
+// Each check prints one line; the exit status is nonzero if any failed.
+//
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "util.h"
+#include "codec.h"
+#include "block.h"
+
+using namespace std;
+
+int failures = 0;
+
+//
+// *This function prints the result of one check.
+//
+void check(string name, bool ok) {
+    cout << (ok ? "ok   " : "FAIL ") << name << endl;
+    if (!ok) failures++;
+}
+
+//
+// *This function returns n pseudo-random bytes drawn from the first
+// alphabet byte values, so small alphabets give skewed, compressible data.
+//
+vector<unsigned char> testData(size_t n, int alphabet, uint32_t seed) {
+    vector<unsigned char> data(n);
+    uint32_t state = seed;
+    for (size_t i = 0; i < n; i++) {
+        state ^= state << 13;  // xorshift32
+        state ^= state >> 17;
+        state ^= state << 5;
+        data[i] = (unsigned char)(state % alphabet);
+    }
+    return data;
+}
+
+//
+// *This function returns data whose byte counts follow the Fibonacci
+// numbers, which gives the longest possible codes and makes compress cap
+// them at CODEC_MAX_LENGTH.
+//
+vector<unsigned char> fibonacciData() {
+    vector<unsigned char> data;
+    uint64_t a = 1, b = 1;
+    for (int s = 0; s < 24; s++) {
+        data.insert(data.end(), (size_t)a, (unsigned char)s);
+        uint64_t next = a + b;
+        a = b;
+        b = next;
+    }
+    return data;
+}
+
+//
+// *This function compresses and decompresses data with the buffer codec.
+// Returns true if it round trips.
+//
+bool codecRoundTrip(const vector<unsigned char> &data, huffcontext &ctx) {
+    vector<unsigned char> compressed(compressBound(data.size()));
+    vector<unsigned char> restored(data.size());
+    size_t size = compress(data.data(), data.size(), compressed.data(),
+                           compressed.size(), ctx);
+    if (size == CODEC_ERROR ||
+        decompressedSize(compressed.data(), size) != data.size()) {
+        return false;
+    }
+    size_t restoredSize = decompress(compressed.data(), size,
+                                     restored.data(), restored.size(), ctx);
+    return restoredSize == data.size() && restored == data;
+}
+
+//
+// *This function checks the buffer codec on inputs that exercise its edge
+// cases, all through one context, as an embedding program would use it.
+//
+void testCodec() {
+    huffcontext* ctx = new huffcontext;
+    check("codec empty", codecRoundTrip(vector<unsigned char>(), *ctx));
+    check("codec one byte", codecRoundTrip(vector<unsigned char>(1, 'x'),
+                                           *ctx));
+    check("codec one symbol",
+          codecRoundTrip(vector<unsigned char>(10000, 'a'), *ctx));
+    check("codec skewed", codecRoundTrip(testData(100000, 5, 1), *ctx));
+    check("codec all bytes", codecRoundTrip(testData(100000, 256, 2),
+                                            *ctx));
+    check("codec long codes", codecRoundTrip(fibonacciData(), *ctx));
+    check("codec context reuse", codecRoundTrip(testData(5000, 5, 1), *ctx));
+
+    vector<unsigned char> data = testData(10000, 16, 3);
+    vector<unsigned char> out(compressBound(data.size()));
+    size_t size = compress(data.data(), data.size(), out.data(), out.size(),
+                           *ctx);
+    check("codec compresses", size != CODEC_ERROR && size < data.size());
+    check("codec output too small",
+          compress(data.data(), data.size(), out.data(), 10, *ctx) ==
+              CODEC_ERROR);
+    vector<unsigned char> restored(data.size());
+    check("codec restore too small",
+          decompress(out.data(), size, restored.data(), data.size() - 1,
+                     *ctx) == CODEC_ERROR);
+    check("codec truncated header",
+          decompress(out.data(), 3, restored.data(), restored.size(),
+                     *ctx) == CODEC_ERROR);
+    // a corrupt bitstream may decode to garbage, but must stay in bounds
+    for (size_t i = CODEC_HEADER_SIZE + CODEC_TABLE_SIZE; i < size; i += 7) {
+        out[i] ^= 0x5A;
+    }
+    size_t corrupt = decompress(out.data(), size, restored.data(),
+                                restored.size(), *ctx);
+    check("codec corrupt input",
+          corrupt == CODEC_ERROR || corrupt <= restored.size());
+    delete ctx;
+}
+
+//
+// *This function writes data as block records and reads them back through
+// readBlock and decodeBlock.  Returns true if it round trips.
+//
+bool blockRoundTrip(const vector<unsigned char> &data, string &records) {
+    ostringstream output;
+    huffblock block;
+    for (size_t start = 0; start < data.size(); start += BLOCK_DEFAULT_SIZE) {
+        size_t n = min(data.size() - start, (size_t)BLOCK_DEFAULT_SIZE);
+        encodeBlock(data.data() + start, n, block);
+        writeBlock(output, block);
+    }
+    records = output.str();
+    istringstream input(records);
+    vector<unsigned char> restored, out;
+    while (input.peek() != EOF) {
+        if (!readBlock(input, block, BLOCK_DEFAULT_SIZE) ||
+            !decodeBlock(block, out, true)) {
+            return false;
+        }
+        restored.insert(restored.end(), out.begin(), out.end());
+    }
+    return restored == data;
+}
+
+//
+// *This function checks block records round trip and that a truncated or
+// oversized record is rejected.
+//
+void testBlocks() {
+    string records;
+    check("blocks empty", blockRoundTrip(vector<unsigned char>(), records));
+    check("blocks text", blockRoundTrip(testData(300000, 40, 4), records));
+    check("blocks random", blockRoundTrip(testData(200000, 256, 5),
+                                          records));
+
+    // one byte value over 2^20 times: tANS scaling must not overflow
+    vector<unsigned char> zeros(2 * 1024 * 1024, 0);
+    huffblock block;
+    vector<unsigned char> out;
+    encodeBlock(zeros.data(), zeros.size(), block);
+    check("blocks one byte value through tANS",
+          block.backend == BACKEND_ANS && decodeBlock(block, out, true) &&
+          out == zeros);
+
+    bool rejected = true;
+    for (size_t n = 0; n < 200 && n < records.size(); n++) {
+        istringstream input(records.substr(0, n));
+        rejected = rejected && !readBlock(input, block, BLOCK_DEFAULT_SIZE);
+    }
+    check("blocks truncated record", rejected);
+    istringstream input(records);
+    check("blocks record over block size",
+          !readBlock(input, block, BLOCK_DEFAULT_SIZE / 2));
+}
+
+int main() {
+    testCodec();
+    testBlocks();
+    return failures == 0 ? 0 : 1;
+}
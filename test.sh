@@ -0,0 +1,204 @@
+#!/bin/sh
+#
+# test.sh
+#
+# Round-trip checks for program.exe, run by "make test".  Each check works
+# on copies in a scratch directory and prints one line; the script exits
+# nonzero if any check fails.
+#
+
+PROGRAM="$(pwd)/program.exe"
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+pass() {
+    echo "ok   $1"
+}
+
+fail() {
+    echo "FAIL $1"
+    FAILED=1
+}
+
+# the sources make a few hundred KB of mixed text
+cat *.h *.cpp > "$WORK/src.txt"
+cd "$WORK" || exit 1
+
+#
+# Compresses a copy of file with options, decompresses it and compares.
+#
+roundtrip() {
+    name=$1
+    file=$2
+    shift 2
+    rm -f rt.txt rt.txt.huf rt_unc.txt
+    cp "$file" rt.txt
+    if "$PROGRAM" compress "$@" rt.txt > /dev/null &&
+       "$PROGRAM" decompress rt.txt.huf > /dev/null &&
+       cmp -s rt.txt rt_unc.txt; then
+        pass "$name"
+    else
+        fail "$name"
+    fi
+}
+
+head -c 20000 src.txt > small.txt
+: > empty.txt
+roundtrip "compress" small.txt
+roundtrip "compress empty" empty.txt
+roundtrip "compress --lz" src.txt --lz
+roundtrip "compress --bwt" src.txt --bwt --block 64
+roundtrip "compress --tokens" src.txt --tokens
+roundtrip "compress --blocks" src.txt --blocks --block 16
+roundtrip "compress --blocks empty" empty.txt --blocks
+"$PROGRAM" compress --blocks --block 9999999999 small.txt > out.txt 2>&1
+status=$?
+if [ $status -eq 1 ] && grep -q "Bad value for --block" out.txt; then
+    pass "compress rejects a --block out of range"
+else
+    fail "compress rejects a --block out of range: exit $status"
+fi
+
+#
+# --range decodes only the blocks it needs, across block boundaries.
+#
+cp src.txt r.txt
+"$PROGRAM" compress --blocks --block 16 r.txt > /dev/null
+"$PROGRAM" decompress --range 20000:40000 r.txt.huf > /dev/null
+tail -c +20001 src.txt | head -c 40000 > want.txt
+if cmp -s r_unc.txt want.txt; then
+    pass "decompress --range"
+else
+    fail "decompress --range"
+fi
+# a length that wraps offset + length still means "to the end"
+"$PROGRAM" decompress --range 20000:18446744073709551615 r.txt.huf > /dev/null
+tail -c +20001 src.txt > want.txt
+if cmp -s r_unc.txt want.txt; then
+    pass "decompress --range to the end"
+else
+    fail "decompress --range to the end"
+fi
+
+#
+# Dedup: the second copy adds no chunks, and manifests find their store
+# from another working directory.
+#
+mkdir -p d/one d/two
+cp src.txt d/one/a.txt
+cp src.txt d/two/b.txt
+"$PROGRAM" compress --dedup d/store d/one/a.txt > /dev/null
+added=$("$PROGRAM" compress --dedup d/store d/two/b.txt)
+if (cd d/two && "$PROGRAM" decompress b.txt.huf > /dev/null) &&
+   "$PROGRAM" decompress d/one/a.txt.huf > /dev/null &&
+   cmp -s d/one/a_unc.txt src.txt && cmp -s d/two/b_unc.txt src.txt; then
+    pass "dedup"
+else
+    fail "dedup"
+fi
+case "$added" in
+    *" 0 new "*) pass "dedup shares chunks" ;;
+    *) fail "dedup shares chunks: $added" ;;
+esac
+
+#
+# An archive extracts every member, and refuses to store a name that could
+# extract outside the current directory.
+#
+mkdir -p ar
+cp small.txt ar/m1.txt
+cp empty.txt ar/m2.txt
+cp src.txt ar/m3.txt
+(cd ar && "$PROGRAM" archive ../all.huf m1.txt m2.txt m3.txt > /dev/null)
+mkdir -p x
+if (cd x && "$PROGRAM" extract ../all.huf > /dev/null) &&
+   cmp -s x/m1_unc.txt small.txt && cmp -s x/m2_unc.txt empty.txt &&
+   cmp -s x/m3_unc.txt src.txt; then
+    pass "archive"
+else
+    fail "archive"
+fi
+if (cd x && "$PROGRAM" archive bad.huf ../small.txt > /dev/null); then
+    fail "archive refuses .. names"
+else
+    pass "archive refuses .. names"
+fi
+# a name length past the directory end, in a directory of the same size
+sed 's/ 6:m3\.txt$/ 99999:m3/' all.huf > long.huf
+if "$PROGRAM" list long.huf > out.txt 2>&1; then
+    fail "archive rejects a name past the directory"
+elif grep -q corrupt out.txt; then
+    pass "archive rejects a name past the directory"
+else
+    fail "archive rejects a name past the directory: $(tail -1 out.txt)"
+fi
+
+#
+# convert skips a legacy file whose table cannot make a tree and converts
+# the rest.
+#
+mkdir -p lg
+cp small.txt lg/l.txt
+(cd lg && "$PROGRAM" compress l.txt > /dev/null && rm l.txt)
+printf '{257:1, 256:1, 97:3}\377\377' > lg/bad.huf
+"$PROGRAM" convert lg > out.txt 2>&1
+status=$?
+if [ $status -eq 1 ] && grep -q "bad.huf" out.txt &&
+   "$PROGRAM" decompress lg/l.txt.huf > /dev/null &&
+   cmp -s lg/l_unc.txt small.txt; then
+    pass "convert skips a bad legacy file"
+else
+    fail "convert skips a bad legacy file: exit $status"
+fi
+
+#
+# Expects decompress to reject a crafted file with a clean error: exit 1,
+# not a crash.
+#
+rejects() {
+    name=$1
+    printf "$2" > bad.txt.huf
+    "$PROGRAM" decompress bad.txt.huf > out.txt 2>&1
+    status=$?
+    if [ $status -eq 1 ]; then
+        pass "$name"
+    else
+        fail "$name: exit $status"
+    fi
+}
+
+# a NOT_A_CHAR key makes a leaf that looks like an internal node
+rejects "bwt table with NOT_A_CHAR" '#W900\n5 0{257:1, 256:1}3\nabc'
+rejects "bwt table key past the alphabet" '#W900\n5 0{999:1, 256:1}3\nabc'
+rejects "token table with NOT_A_CHAR" '#T5\n1\n2:ab{257:1, 256:1}3\nabc'
+rejects "token table key past the dictionary" \
+    '#T5\n1\n2:ab{259:1, 256:1}3\nabc'
+
+#
+# --verify on a truncated or corrupted block file must report it corrupt and
+# exit nonzero, not hang or crash.
+#
+cp src.txt v.txt
+"$PROGRAM" compress --blocks --block 16 v.txt > /dev/null
+size=$(wc -c < v.txt.huf)
+head -c $((size / 2)) v.txt.huf > t.txt.huf
+if "$PROGRAM" decompress --verify t.txt.huf > out.txt 2>&1; then
+    fail "verify truncated block file: exit 0"
+elif grep -q Corrupt out.txt; then
+    pass "verify truncated block file"
+else
+    fail "verify truncated block file: $(tail -1 out.txt)"
+fi
+cp v.txt.huf c.txt.huf
+printf 'XXXX' | dd of=c.txt.huf bs=1 seek=$((size / 3)) conv=notrunc \
+    2> /dev/null
+if "$PROGRAM" decompress --verify c.txt.huf > out.txt 2>&1; then
+    fail "verify corrupted block file: exit 0"
+elif grep -q Corrupt out.txt; then
+    pass "verify corrupted block file"
+else
+    fail "verify corrupted block file: $(tail -1 out.txt)"
+fi
+
+exit $FAILED
@@ -0,0 +1,236 @@
+//
+// tokens.h
+//
+// A token-level alphabet for text.  The input is split into words, runs of
+// whitespace and single punctuation characters.  Tokens that repay their
+// place in the dictionary get a symbol of their own, so a whole word costs
+// one Huffman code; every other token is spelled with the byte symbols
+// 0-255, which serve as the escape path.  The tree is the usual one from
+// buildEncodingTree over the int symbols:
+//      0-255                  literal bytes
+//      PSEUDO_EOF             end of data
+//      TOKEN_BASE + i         dictionary token i
+//
+// File layout:
+//      #T<uncompressed size>\n
+//      <token count>\n<length>:<bytes> ... (one per dictionary token)
+//      {map}<payload bytes>\n<payload>
+//
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cctype>
+#include "hashmap.h"
+#include "bitbuffer.h"
+#include "huffcode.h"
+#include "util.h"
+
+using namespace std;
+
+const char TOKEN_MODE = 'T';
+const int TOKEN_BASE = NOT_A_CHAR + 1;
+const int TOKEN_MAX_DICTIONARY = 4096;
+const size_t TOKEN_MEMORY_COST = 8;  // bytes held per byte of input
+
+//
+// *This function returns the class of a byte: 0 for word characters
+// (letters, digits, '_' and non-ASCII bytes, so UTF-8 words stay whole),
+// 1 for whitespace and 2 for punctuation.
+//
+inline int tokenClass(unsigned char c) {
+    if (isalnum(c) || c == '_' || c >= 0x80) return 0;
+    if (isspace(c)) return 1;
+    return 2;
+}
+
+//
+// *This function splits data into tokens.  Each token is returned as its
+// start offset; a token ends where the next one starts.
+//
+inline void tokenize(const vector<unsigned char> &data,
+                     vector<size_t> &starts) {
+    size_t i = 0;
+    while (i < data.size()) {
+        starts.push_back(i);
+        int cls = tokenClass(data[i]);
+        i++;
+        if (cls == 2) continue;  // punctuation is always one character
+        while (i < data.size() && tokenClass(data[i]) == cls) i++;
+    }
+}
+
+//
+// *This function picks the dictionary: tokens of two or more characters that
+// save more than they cost to store, the largest savings first.
+//
+inline void buildTokenDictionary(const vector<unsigned char> &data,
+                                 const vector<size_t> &starts,
+                                 vector<string> &dictionary) {
+    unordered_map<string, int> counts;
+    for (unsigned int i = 0; i < starts.size(); i++) {
+        size_t end = i + 1 < starts.size() ? starts[i + 1] : data.size();
+        if (end - starts[i] < 2) continue;
+        counts[string(data.begin() + starts[i], data.begin() + end)]++;
+    }
+    vector<pair<long, string> > candidates;
+    for (auto &e : counts) {
+        long length = (long)e.first.length();
+        long saving = (long)e.second * (length - 1) - (length + 4);
+        if (e.second >= 2 && saving > 0) {
+            candidates.push_back(make_pair(saving, e.first));
+        }
+    }
+    sort(candidates.rbegin(), candidates.rend());
+    for (unsigned int i = 0; i < candidates.size() &&
+                             i < (unsigned int)TOKEN_MAX_DICTIONARY; i++) {
+        dictionary.push_back(candidates[i].second);
+    }
+}
+
+//
+// *This function compresses filename into (filename + ".huf") with the token
+// alphabet.  Returns the compressed size in bytes, or -1 on error.
+//
+inline long tokenCompress(string filename) {
+    vector<unsigned char> data;
+    if (!readFileBytes(filename, data)) return -1;
+    vector<size_t> starts;
+    tokenize(data, starts);
+    vector<string> dictionary;
+    buildTokenDictionary(data, starts, dictionary);
+    unordered_map<string, int> symbolOf;
+    for (unsigned int i = 0; i < dictionary.size(); i++) {
+        symbolOf[dictionary[i]] = TOKEN_BASE + i;
+    }
+
+    // map tokens to symbols, spelling the ones not in the dictionary
+    vector<int> symbols;
+    for (unsigned int i = 0; i < starts.size(); i++) {
+        size_t end = i + 1 < starts.size() ? starts[i + 1] : data.size();
+        auto found = symbolOf.end();
+        if (end - starts[i] >= 2) {
+            found = symbolOf.find(string(data.begin() + starts[i],
+                                         data.begin() + end));
+        }
+        if (found != symbolOf.end()) {
+            symbols.push_back(found->second);
+        } else {
+            for (size_t j = starts[i]; j < end; j++) {
+                symbols.push_back(data[j]);
+            }
+        }
+    }
+    symbols.push_back(PSEUDO_EOF);
+
+    int alphabetSize = TOKEN_BASE + (int)dictionary.size();
+    vector<int> counts(alphabetSize, 0);
+    for (unsigned int i = 0; i < symbols.size(); i++) counts[symbols[i]]++;
+    hashmapF frequencyMap;
+    buildFrequencyMap(counts, frequencyMap);
+    HuffmanNode* tree = buildCodingTree(frequencyMap);
+    vector<HuffmanCode> codes = buildCodeTable(tree, alphabetSize);
+    freeTree(tree);
+    obitbuffer bits;
+    for (unsigned int i = 0; i < symbols.size(); i++) {
+        writeSymbol(bits, codes, symbols[i]);
+    }
+
+    ofstream output(filename + ".huf", ios::binary);
+    output << HEADER_TAG << TOKEN_MODE << data.size() << '\n';
+    output << dictionary.size() << '\n';
+    for (unsigned int i = 0; i < dictionary.size(); i++) {
+        output << dictionary[i].length() << ':' << dictionary[i];
+    }
+    vector<unsigned char> &payload = bits.bytes();
+    output << frequencyMap << payload.size() << '\n';
+    writeBytes(output, payload.data(), payload.size());
+    long size = (long)output.tellp();
+    output.close();
+    return size;
+}
+
+//
+// *This function decompresses a file written by tokenCompress.  The output is
+// named the same way decompress names it.  Returns false if the file is
+// corrupt.
+//
+inline bool tokenDecompress(string filename) {
+    ifstream input(filename.substr(0, filename.find(".huf")) + ".huf",
+                   ios::binary);
+    size_t rawSize = 0, tokenCount = 0;
+    if (input.get() != HEADER_TAG || input.get() != TOKEN_MODE ||
+        !(input >> rawSize >> tokenCount) || input.get() != '\n' ||
+        tokenCount > (size_t)TOKEN_MAX_DICTIONARY) {
+        cout << "Not a token file." << endl;
+        return false;
+    }
+    // lengths are checked against the file before anything is allocated;
+    // every code is at least a bit and spells at most longest bytes
+    vector<string> dictionary(tokenCount);
+    size_t longest = 1;
+    for (size_t i = 0; i < tokenCount && input; i++) {
+        size_t length = 0;
+        if (!(input >> length) || input.get() != ':' ||
+            length > bytesLeft(input)) {
+            input.setstate(ios::failbit);
+            break;
+        }
+        dictionary[i].resize(length);
+        if (length > 0) input.read(&dictionary[i][0], length);
+        longest = max(longest, length);
+    }
+    hashmapF frequencyMap;
+    size_t payloadSize = 0;
+    // keys are bytes, PSEUDO_EOF or one of the tokenCount tokens
+    if (!input ||
+        !readFrequencyMap(input, frequencyMap,
+                          TOKEN_BASE + (int)tokenCount) ||
+        !(input >> payloadSize) || input.get() != '\n' ||
+        payloadSize > bytesLeft(input) ||
+        rawSize / longest / 8 > payloadSize) {
+        cout << "Corrupt token data." << endl;
+        return false;
+    }
+    vector<unsigned char> payload(payloadSize);
+    if (payloadSize > 0) input.read((char*)&payload[0], payloadSize);
+    HuffmanNode* tree = input ? buildCodingTree(frequencyMap) : nullptr;
+    if (tree == nullptr) {
+        cout << "Corrupt token data." << endl;
+        return false;
+    }
+
+    string out;
+    out.reserve(rawSize);
+    ibitbuffer bits(payload.data(), payload.size());
+    bool ok = true;
+    while (true) {
+        int symbol = readSymbol(bits, tree);
+        if (symbol < PSEUDO_EOF) {
+            out += (char)symbol;
+        } else if (symbol == PSEUDO_EOF) {
+            break;
+        } else if (symbol - TOKEN_BASE < (int)dictionary.size()) {
+            out += dictionary[symbol - TOKEN_BASE];
+        } else {
+            ok = false;
+        }
+        if (!ok || out.size() > rawSize || bits.overrun()) {
+            ok = false;
+            break;
+        }
+    }
+    freeTree(tree);
+    if (!ok || out.size() != rawSize) {
+        cout << "Corrupt token data." << endl;
+        return false;
+    }
+    ofstream output(uncompressedFilename(filename), ios::binary);
+    output << out;
+    output.close();
+    return true;
+}